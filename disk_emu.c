@@ -3,23 +3,73 @@
 #include <string.h>
 // #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
 #include "disk_emu.h"
 
 
-FILE* fp = NULL;
-double L, p;
-double r;
-int BLOCK_SIZE, MAX_BLOCK, MAX_RETRY, lru;
+/*One emulated disk: its file, geometry and simulated latency & failures*/
+struct disk_t
+{
+    FILE* fp;
+    int block_size;
+    int max_block;
+    double L, p;
+    double r;
+    int MAX_RETRY, lru;
+    /*Serializes block reads and writes, each is a seek followed by reads or writes of fp*/
+    pthread_mutex_t lock;
+};
+
+/*Disk of threads that never picked one, and the disk each thread uses*/
+static disk_t default_disk = {NULL, 0, 0, 0, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+static __thread disk_t* cur_disk = &default_disk;
+
+/*----------------------------------------------------------*/
+/*Creates a disk with no file, to be set up with init_disk   */
+/*or init_fresh_disk while it is the thread's disk          */
+/*----------------------------------------------------------*/
+disk_t* new_disk()
+{
+    disk_t* disk = calloc(1, sizeof(disk_t));
+    if (disk == NULL)
+        return NULL;
+    pthread_mutex_init(&disk->lock, NULL);
+    return disk;
+}
+
+/*----------------------------------------------------------*/
+/*Frees a disk from new_disk (closing its file)             */
+/*----------------------------------------------------------*/
+void free_disk(disk_t* disk)
+{
+    if (disk == NULL || disk == &default_disk)
+        return;
+    if (NULL != disk->fp)
+        fclose(disk->fp);
+    pthread_mutex_destroy(&disk->lock);
+    free(disk);
+}
+
+/*----------------------------------------------------------*/
+/*Makes disk the one the calling thread's calls use (NULL   */
+/*for the default disk), returns the one used before        */
+/*----------------------------------------------------------*/
+disk_t* use_disk(disk_t* disk)
+{
+    disk_t* previous = cur_disk;
+    cur_disk = (disk == NULL) ? &default_disk : disk;
+    return previous;
+}
 
 /*----------------------------------------------------------*/
 /*Close the disk file filled when you don't need it anymore. */
 /*----------------------------------------------------------*/
 int close_disk()
 {
-    if(NULL != fp)
+    if(NULL != cur_disk->fp)
     {
-        fclose(fp);
-        fp = NULL;
+        fclose(cur_disk->fp);
+        cur_disk->fp = NULL;
     }
     return 0;
 }
@@ -32,19 +82,20 @@ int init_fresh_disk(char *filename, int block_size, int num_blocks)
     int i, j;
     
     /*Set up latency at 0.02 second*/
-    L = 00000.f;
+    cur_disk->L = 00000.f;
     /*Set up failure at 10%*/
-    p = -1.f;
+    cur_disk->p = -1.f;
     /*Set up max retry attempts after failure to 3*/
-    MAX_RETRY = 3;
+    cur_disk->MAX_RETRY = 3;
 
-    BLOCK_SIZE = block_size;
-    MAX_BLOCK = num_blocks;
+    cur_disk->block_size = block_size;
+    cur_disk->max_block = num_blocks;
     
     /*Initializes the random number generator*/
     srand((unsigned int)(time( 0 )) );
     /*Creates a new file*/
-    fp = fopen (filename, "w+b");
+    FILE* fp = fopen (filename, "w+b");
+    cur_disk->fp = fp;
 
     if (fp == NULL)
     {
@@ -53,9 +104,9 @@ int init_fresh_disk(char *filename, int block_size, int num_blocks)
     }
     
     /*Fills the file with 0's to its given size*/
-    for (i = 0; i < MAX_BLOCK; i++)
+    for (i = 0; i < num_blocks; i++)
     {
-        for (j = 0; j < BLOCK_SIZE; j++)
+        for (j = 0; j < block_size; j++)
         {
             fputc(0, fp);
         }
@@ -68,22 +119,22 @@ int init_fresh_disk(char *filename, int block_size, int num_blocks)
 int init_disk(char *filename, int block_size, int num_blocks)
 {
     /*Set up latency at 0.02 second*/
-    L = 00000.f;
+    cur_disk->L = 00000.f;
     /*Set up failure at 10%*/
-    p = -1.f;
+    cur_disk->p = -1.f;
     /*Set up max retry attempts after failure to 3*/
-    MAX_RETRY = 3;
+    cur_disk->MAX_RETRY = 3;
 
-    BLOCK_SIZE = block_size;
-    MAX_BLOCK = num_blocks;
+    cur_disk->block_size = block_size;
+    cur_disk->max_block = num_blocks;
     
     /*Initializes the random number generator*/
     srand((unsigned int)(time( 0 )) );
     
     /*Opens a file*/
-    fp = fopen (filename, "r+b");
+    cur_disk->fp = fopen (filename, "r+b");
 
-    if (fp == NULL)
+    if (cur_disk->fp == NULL)
     {
         printf("Could not open %s\n\n", filename);
         return -1;
@@ -98,32 +149,35 @@ int read_blocks(int start_address, int nblocks, void *read_buffer)
 {
     char* buffer = (char*) read_buffer;
     int i, e, s;
+    disk_t* disk = cur_disk;
     e = 0;
     s = 0;
 
     /*Sets up a temporary buffer*/
-    void* blockRead = (void*) malloc(BLOCK_SIZE);
+    void* blockRead = (void*) malloc(disk->block_size);
 
     /*Checks that the data requested is within the range of addresses of the disk*/
-    if (start_address + nblocks > MAX_BLOCK)
+    if (start_address + nblocks > disk->max_block)
     {
         printf("Disk read out of bound address error: %d\n", start_address);
         return -1;
     }
 
     /*Goto the data requested from the disk*/
-    fseek(fp, start_address * BLOCK_SIZE, SEEK_SET);
+    pthread_mutex_lock(&disk->lock);
+    fseek(disk->fp, (long) start_address * disk->block_size, SEEK_SET);
 
     /*For every block requested*/
     for (i = 0; i < nblocks; ++i)
     {
         /*Pause until the latency duration is elapsed*/
-        // usleep(L);
+        // usleep(disk->L);
 
         s++;
-        fread(blockRead, BLOCK_SIZE, 1, fp);
-        memcpy(buffer+(i*BLOCK_SIZE), blockRead, BLOCK_SIZE);
+        fread(blockRead, disk->block_size, 1, disk->fp);
+        memcpy(buffer+(i*disk->block_size), blockRead, disk->block_size);
     }
+    pthread_mutex_unlock(&disk->lock);
 
     free(blockRead);
 
@@ -142,33 +196,36 @@ int write_blocks(int start_address, int nblocks, void *write_buffer)
 {
     char* buffer = (char*) write_buffer;
     int i, e, s;
+    disk_t* disk = cur_disk;
     e = 0;
     s = 0;
 
-    void* blockWrite = (void*) malloc(BLOCK_SIZE);
+    void* blockWrite = (void*) malloc(disk->block_size);
 
     /*Checks that the data requested is within the range of addresses of the disk*/
-    if (start_address + nblocks > MAX_BLOCK)
+    if (start_address + nblocks > disk->max_block)
     {
         printf("Disk write out of bound address error: %d\n", start_address);
         return -1;
     }
 
     /*Goto where the data is to be written on the disk*/        
-    fseek(fp, start_address * BLOCK_SIZE, SEEK_SET);
+    pthread_mutex_lock(&disk->lock);
+    fseek(disk->fp, (long) start_address * disk->block_size, SEEK_SET);
 
     /*For every block requested*/        
     for (i = 0; i < nblocks; ++i)
     {
         /*Pause until the latency duration is elapsed*/
-        //usleep(L);
+        //usleep(disk->L);
 
-        memcpy(blockWrite, buffer+(i*BLOCK_SIZE), BLOCK_SIZE);
+        memcpy(blockWrite, buffer+(i*disk->block_size), disk->block_size);
 
-        fwrite(blockWrite, BLOCK_SIZE, 1, fp);
-        fflush(fp);
+        fwrite(blockWrite, disk->block_size, 1, disk->fp);
+        fflush(disk->fp);
         s++;
     }
+    pthread_mutex_unlock(&disk->lock);
     free(blockWrite);
 
     /*If no failure return the number of blocks written, else return the negative number of failures*/
@@ -1,6 +1,13 @@
 #ifndef DISK_H
 #define DISK_H
 
+/*An emulated disk. The calls below use the calling thread's disk (use_disk), the default one until it picks one*/
+typedef struct disk_t disk_t;
+
+disk_t* new_disk();
+void free_disk(disk_t* disk);
+disk_t* use_disk(disk_t* disk);
+
 int init_fresh_disk(char *filename, int block_size, int num_blocks);
 int init_disk(char *filename, int block_size, int num_blocks);
 int read_blocks(int start_address, int nblocks, void *read_buffer);
@@ -36,7 +36,7 @@ static int fuse_getattr(const char *path, struct stat *stbuf)
 static int fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
         off_t offset, struct fuse_file_info *fi)
 {
-    char file_name[MAXFILENAME];
+    char file_name[MAXFILENAME + 1];
     
     if (strcmp(path, "/") != 0)
         return -ENOENT;
@@ -93,10 +93,7 @@ static int fuse_read(const char *path, char *buf, size_t size, off_t offset,
     if (fd == -1)
         return -errno;
     
-    if(sfs_fseek(fd, offset) == -1)
-        return -errno;
-    
-    res = sfs_fread(fd, buf, size);
+    res = sfs_pread(fd, buf, size, offset);
     if (res == -1)
         return -errno;
     
@@ -118,10 +115,7 @@ static int fuse_write(const char *path, const char *buf, size_t size,
     if (fd == -1) 
         return -errno;
     
-    if(sfs_fseek(fd, offset) == -1)
-        return -errno;
-    
-    res = sfs_fwrite(fd, buf, size);
+    res = sfs_pwrite(fd, buf, size, offset);
     if (res == -1)
         return -errno;
     
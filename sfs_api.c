@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
 #include "sfs_api.h"
 #include "disk_emu.h"
 
@@ -15,46 +18,81 @@
 #define INODE_TABLE_LENGTH 48 // blocks allocated to iNodes
 #define BLOCK_SIZE 1024       // bytes in a block
 #define FILE_SYSTEM_SIZE 1024 // blocks in the file system (on disk)
-
-// Cached values
-FileDescriptorTable fdt;
-Directory cur_directory;
-SuperBlock super_block;
-
-
-// Used in directory.c and inode.c
-int POINTERS_PER_BLOCK;
-int INODES_PER_BLOCK;
-int MAX_FILE_BLOCKS;
-int MAX_FILE_ID = 0;
-static int directory_iterator_index = 0;
-
-
+#define RECLAIM_BATCH 32      // orphans the background reclaimer frees per hold of the file system lock
+
+// The file system of threads that haven't picked one (sfs_use), on DISK_NAME. The first mksfs makes its caches
+static sfs_t default_fs = {.disk_name = DISK_NAME,
+                           .disk = NULL,
+                           .geometry = {.magic_number=SUPPORTED_SYSTEM,
+                                        .block_size=BLOCK_SIZE,
+                                        .file_system_size=FILE_SYSTEM_SIZE,
+                                        .inode_table_length=INODE_TABLE_LENGTH,
+                                        .root_directory=-1,
+                                        .orphan_head=-1},
+                           .default_session = {.fs = &default_fs, .cur_inode = -1, .iterator_index = 0, .listing = NULL,
+                                               .listing_lock = PTHREAD_MUTEX_INITIALIZER, .next = NULL},
+                           .sessions = &default_fs.default_session,
+                           .fs_lock = PTHREAD_RWLOCK_INITIALIZER,
+                           .reclaim_lock = PTHREAD_MUTEX_INITIALIZER,
+                           .reclaim_cond = PTHREAD_COND_INITIALIZER};
+
+__thread sfs_t* cur_fs = &default_fs;
+
+
+// Helper - write buffered appends of every open file (and directory) to disk
+static void syncAll() {
+    for(int i = 0; i < fdt.allocated; i++) {
+        if(fdt.table[i].inode_idx >= 0) flushFDTNode(i);
+    }
+}
 
 // Helper method to clear values. Will do nothing if uninitialized
 static void closeSFS() {
+    syncAll(); // Buffered appends still need to reach the disk
     close_disk();
+    for(int i = 0; i < fdt.nodes_allocated; i++) {
+        if(fdt.nodes[i].inode_idx >= 0) free(fdt.nodes[i].tail_buffer);
+    }
     free(fdt.table);
-    free(fdt.inodes);
-    free(cur_directory.file_inode_map);
+    free(fdt.free_slots);
+    free(fdt.nodes);
+    free(fdt.free_nodes);
+    free(fdt.inode_map);
 }
 
-// Initialize file system (cache and constants), either loading in or creating with defaults
-void mksfs(int fresh) {
+// Helper - make the fdt and the caches of every layer for fs. Returns success (nothing made on failure)
+static bool setupFS(sfs_t* fs) {
+    FileDescriptorTable* files = calloc(1, sizeof(FileDescriptorTable));
+    INodeCaches* inode_caches = newINodeCaches();
+    FreeBitMap* bit_map = newFreeBitMap();
+    DirectoryCaches* directory_caches = newDirectoryCaches();
+    if(files == NULL || inode_caches == NULL || bit_map == NULL || directory_caches == NULL) {
+        if(files == NULL) fprintf(stderr, "ERROR: Unable to allocate file descriptor table memory!\n");
+        free(files);
+        freeINodeCaches(inode_caches);
+        freeFreeBitMap(bit_map);
+        freeDirectoryCaches(directory_caches);
+        return false;
+    }
+    fs->files = files;
+    fs->inode_caches = inode_caches;
+    fs->bit_map = bit_map;
+    fs->directory_caches = directory_caches;
+    return true;
+}
+
+// Helper - create (with cur_fs->geometry) or load the calling thread's file system, fs_lock held. Returns success
+static bool mountFS(bool fresh) {
     closeSFS();
 
     // Just in case, createFreeBitMap needs super_block to have defaults at least
-    super_block = (SuperBlock) {.magic_number=SUPPORTED_SYSTEM, 
-                                .block_size=BLOCK_SIZE, 
-                                .file_system_size=FILE_SYSTEM_SIZE, 
-                                .inode_table_length=INODE_TABLE_LENGTH, 
-                                .root_directory=-1};
-    fdt = (FileDescriptorTable) {.table=NULL, .inodes=NULL, .size=0, .allocated=0};
-    cur_directory =  (Directory) {.parent_inode_index=-1, 
-                                .file_inode_map=NULL, 
-                                .file_number=0, 
-                                .table_size=0, 
-                                .fdt_index=-1};
+    super_block = cur_fs->geometry;
+    fdt = (FileDescriptorTable) {.table=NULL, .nodes=NULL, .size=0, .allocated=0, .free_slots=NULL, .free_count=0,
+                                 .node_count=0, .nodes_allocated=0, .free_nodes=NULL, .free_node_count=0,
+                                 .inode_map=NULL, .map_size=0};
+    resetDirectoryCaches(); // Unpins every current directory, and handles went with the old fdt
+    resetINodeCache();
+    for(sfs_session* session = cur_fs->sessions; session != NULL; session = session->next) session->cur_inode = -1;
 
     if(fresh) {
         // Use defaults
@@ -62,22 +100,23 @@ void mksfs(int fresh) {
         INODES_PER_BLOCK = super_block.block_size / sizeof(iNode);
         MAX_FILE_BLOCKS = 12 + POINTERS_PER_BLOCK + POINTERS_PER_BLOCK * POINTERS_PER_BLOCK;
         
-        init_fresh_disk(DISK_NAME, super_block.block_size, super_block.file_system_size);
+        if(init_fresh_disk(cur_fs->disk_name, super_block.block_size, super_block.file_system_size) < 0) return false;
         createFreeBitMap();
 
         // Create root directory
-        int root_fdt_ind = createDirectoryFile(ROOT_DIR_NAME, true);
+        int root_fdt_ind = createDirectoryFile(-1, ROOT_DIR_NAME, true);
         super_block.root_directory = fdt.table[root_fdt_ind].inode_idx;
+        closeFDTNode(root_fdt_ind);
         saveSuperBlock();
     } else {
         // Read super block
-        init_disk(DISK_NAME, super_block.block_size, 1); 
+        if(init_disk(cur_fs->disk_name, super_block.block_size, 1) < 0) return false;
         readSuperBlock();
         close_disk();
 
         if(super_block.magic_number != SUPPORTED_SYSTEM) {
             fprintf(stderr, "Existing file system not supported by sfs. Exiting...\n");
-            return; // If I had full design perms I'd make this return false or -1
+            return false;
         }
 
         // Use super block to init constants
@@ -86,80 +125,413 @@ void mksfs(int fresh) {
         MAX_FILE_BLOCKS = 12 + POINTERS_PER_BLOCK + POINTERS_PER_BLOCK * POINTERS_PER_BLOCK;
         
 
-        init_disk(DISK_NAME, super_block.block_size, super_block.file_system_size);
+        init_disk(cur_fs->disk_name, super_block.block_size, super_block.file_system_size);
 
         // Needed super_block loaded
         loadFreeBitMap();
+        if(super_block.orphan_head >= 0) wakeReclaimer(); // Files removed before the last shutdown (or crash)
         MAX_FILE_ID = find_number_files();
     }    
-    loadDirectory(super_block.root_directory, true);
+    loadDirectory(super_block.root_directory, false);
+    // Every session starts over in the root
+    for(sfs_session* session = cur_fs->sessions; session != NULL; session = session->next) {
+        session->cur_inode = super_block.root_directory;
+        session->iterator_index = 0;
+        pinDirectory(session->cur_inode);
+    }
+    return true;
+}
+
+// Initialize file system (cache and constants), either loading in or creating with defaults
+void mksfs(int fresh) {
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    if(cur_fs->files != NULL || setupFS(cur_fs)) mountFS(fresh);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+}
+
+// Helper - whether a new file system of the given geometry fits the layout: the free bit map takes one block (the
+// data block reference counts as many as they need), and blocks must hold a directory header and a few name index keys
+static bool validGeometry(const SuperBlock* geometry) {
+    int data_blocks = dataBlockCount(geometry);
+    int inodes = geometry->inode_table_length * (geometry->block_size / (int) sizeof(iNode));
+    int bit_map_bytes = (inodes + 7) / 8 + (data_blocks + 7) / 8;
+    return geometry->block_size >= 512 && geometry->block_size % (int) sizeof(int) == 0
+           && geometry->inode_table_length > 0 && data_blocks > 0 && bit_map_bytes <= geometry->block_size;
+}
+
+// Helper - the background reclaimer of a file system: frees its orphans a batch at a time (holding fs_lock shared
+// for each, so calls waiting for it run in between) whenever woken, until stopped
+static void* runReclaimer(void* arg) {
+    sfs_t* fs = arg;
+    sfs_use(fs);
+    pthread_mutex_lock(&fs->reclaim_lock);
+    while(true) {
+        while(!fs->reclaim_wanted && !fs->reclaimer_stop) pthread_cond_wait(&fs->reclaim_cond, &fs->reclaim_lock);
+        if(fs->reclaimer_stop) break;
+        fs->reclaim_wanted = false;
+        pthread_mutex_unlock(&fs->reclaim_lock);
+
+        int reclaimed = sfs_reclaim(RECLAIM_BATCH);
+        sched_yield();
+        pthread_mutex_lock(&fs->reclaim_lock);
+        if(reclaimed == RECLAIM_BATCH) fs->reclaim_wanted = true; // Maybe more left
+    }
+    pthread_mutex_unlock(&fs->reclaim_lock);
+    return NULL;
+}
+
+// Have the calling thread's background reclaimer free the orphan list, starting it if needed (see sfs_instance.h)
+void wakeReclaimer() {
+    sfs_t* fs = cur_fs;
+    pthread_mutex_lock(&fs->reclaim_lock);
+    fs->reclaim_wanted = true;
+    if(!fs->reclaimer_running && !fs->reclaimer_stop) {
+        // Without it, orphans are still freed when the disk runs out, by sfs_reclaim or on the next mount
+        fs->reclaimer_running = pthread_create(&fs->reclaimer, NULL, runReclaimer, fs) == 0;
+    }
+    pthread_cond_signal(&fs->reclaim_cond);
+    pthread_mutex_unlock(&fs->reclaim_lock);
+}
+
+// Helper - stop the background reclaimer of fs (if started) and wait for it. fs_lock not held
+static void stopReclaimer(sfs_t* fs) {
+    pthread_mutex_lock(&fs->reclaim_lock);
+    fs->reclaimer_stop = true;
+    pthread_cond_signal(&fs->reclaim_cond);
+    bool running = fs->reclaimer_running;
+    pthread_mutex_unlock(&fs->reclaim_lock);
+    if(running) pthread_join(fs->reclaimer, NULL);
+}
+
+// Mount the file system image at path as a new file system, see sfs_api.h. Returns NULL on error
+sfs_t* sfs_mount(const char* path, const sfs_options* options) {
+    sfs_options defaults = {.fresh = 0, .block_size = 0, .file_system_size = 0, .inode_table_length = 0};
+    if(path == NULL) return NULL;
+    if(options == NULL) options = &defaults;
+
+    SuperBlock geometry = default_fs.geometry;
+    if(options->block_size > 0) geometry.block_size = options->block_size;
+    if(options->file_system_size > 0) geometry.file_system_size = options->file_system_size;
+    if(options->inode_table_length > 0) geometry.inode_table_length = options->inode_table_length;
+    if(options->fresh && !validGeometry(&geometry)) return NULL;
+
+    sfs_t* fs = calloc(1, sizeof(sfs_t));
+    char* disk_name = malloc(strlen(path) + 1);
+    disk_t* disk = new_disk();
+    if(fs == NULL || disk_name == NULL || disk == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate file system memory!\n");
+        free(fs);
+        free(disk_name);
+        free_disk(disk);
+        return NULL;
+    }
+    strcpy(disk_name, path);
+    fs->disk_name = disk_name;
+    fs->disk = disk;
+    fs->geometry = geometry;
+    fs->default_session = (sfs_session) {.fs = fs, .cur_inode = -1, .iterator_index = 0, .listing = NULL, .next = NULL};
+    pthread_mutex_init(&fs->default_session.listing_lock, NULL);
+    fs->sessions = &fs->default_session;
+    pthread_rwlock_init(&fs->fs_lock, NULL);
+    pthread_mutex_init(&fs->reclaim_lock, NULL);
+    pthread_cond_init(&fs->reclaim_cond, NULL);
+    if(!setupFS(fs)) {
+        sfs_unmount(fs);
+        return NULL;
+    }
+
+    sfs_t* caller_fs = sfs_use(fs);
+    pthread_rwlock_wrlock(&fs->fs_lock);
+    bool mounted = mountFS(options->fresh != 0);
+    pthread_rwlock_unlock(&fs->fs_lock);
+    sfs_use(caller_fs);
+    if(!mounted) {
+        sfs_unmount(fs);
+        return NULL;
+    }
+    return fs;
+}
+
+// Save and close a file system from sfs_mount, ending its sessions. Threads using it go back to the default one
+void sfs_unmount(sfs_t* fs) {
+    if(fs == NULL || fs == &default_fs) return;
+    waitAsyncRequests(fs); // Workers still running its requests would use it after it is freed
+    stopReclaimer(fs); // Orphans it didn't get to stay on disk, freed once mounted again
+    sfs_t* caller_fs = sfs_use(fs);
+    pthread_rwlock_wrlock(&fs->fs_lock);
+    if(fs->files != NULL) closeSFS();
+    while(fs->sessions != &fs->default_session) {
+        sfs_session* session = fs->sessions;
+        fs->sessions = session->next;
+        freeDirectoryWindow(session->listing);
+        pthread_mutex_destroy(&session->listing_lock);
+        free(session);
+    }
+    freeDirectoryWindow(fs->default_session.listing);
+    pthread_mutex_destroy(&fs->default_session.listing_lock);
+    pthread_rwlock_unlock(&fs->fs_lock);
+    sfs_use(caller_fs == fs ? NULL : caller_fs);
+
+    free(fs->files);
+    freeINodeCaches(fs->inode_caches);
+    freeFreeBitMap(fs->bit_map);
+    freeDirectoryCaches(fs->directory_caches);
+    free_disk(fs->disk);
+    free(fs->disk_name);
+    pthread_rwlock_destroy(&fs->fs_lock);
+    pthread_mutex_destroy(&fs->reclaim_lock);
+    pthread_cond_destroy(&fs->reclaim_cond);
+    free(fs);
+}
+
+// Make fs the file system of the calling thread's calls (NULL for the default one). Returns the one it used before
+sfs_t* sfs_use(sfs_t* fs) {
+    sfs_t* previous = cur_fs;
+    cur_fs = (fs == NULL) ? &default_fs : fs;
+    use_disk(cur_fs->disk);
+    return previous;
+}
+
+
+// Helper - mark an fdt index returned to a client as the session's (negative fileID passed through)
+static int ownHandle(sfs_session* session, int fileID) {
+    if(fileID >= 0) fdt.table[fileID].owner = session;
+    return fileID;
+}
+
+// Start a new session in the root directory. Returns NULL on error
+sfs_session* sfs_session_open() {
+    sfs_session* session = malloc(sizeof(sfs_session));
+    if(session == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate session memory!\n");
+        return NULL;
+    }
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    *session = (sfs_session) {.fs = cur_fs, .cur_inode = super_block.root_directory, .iterator_index = 0,
+                              .listing = NULL, .next = cur_fs->sessions};
+    pthread_mutex_init(&session->listing_lock, NULL);
+    bool pinned = pinDirectory(session->cur_inode);
+    if(pinned) cur_fs->sessions = session;
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    if(!pinned) {
+        pthread_mutex_destroy(&session->listing_lock);
+        free(session);
+        return NULL;
+    }
+    return session;
+}
+
+// End a session, closing every handle it still has open (the default session can't be closed). Works on the
+// session's own file system, whichever one the calling thread uses
+void sfs_session_close(sfs_session* session) {
+    if(session == NULL || session == &session->fs->default_session) return;
+    sfs_t* caller_fs = sfs_use(session->fs);
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    for(int i = 0; i < fdt.allocated; i++) {
+        if(fdt.table[i].inode_idx >= 0 && fdt.table[i].owner == session) closeFDTNode(i);
+    }
+    unpinDirectory(session->cur_inode);
+    sfs_session** link = &cur_fs->sessions;
+    while(*link != session) link = &(*link)->next;
+    *link = session->next;
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    sfs_use(caller_fs);
+    freeDirectoryWindow(session->listing);
+    pthread_mutex_destroy(&session->listing_lock);
+    free(session);
 }
 
 
 // Used by FUSE for iterator through directory - read into fname, return 1 on success, 0 on end of list
 int sfs_getnextfilename(char* fname) {
-    if(directory_iterator_index >= cur_directory.file_number) {
-        directory_iterator_index = 0;
-        return 0;
+    int is_directory;
+    return sfs_getnextentry(fname, &is_directory);
+}
+
+// Same iterator as sfs_getnextfilename, also giving the entry type - return 1 on success, 0 on end of list
+int sfs_getnextentry(char* fname, int* is_directory) {
+    return sfs_session_getnextentry(&cur_fs->default_session, fname, is_directory);
+}
+
+// Helper - lock for listing the session's current directory: fs_lock shared if the directory is cached (nothing
+// pushes it out until fs_lock is held exclusive), exclusive if it has to be opened. Then the session's listing lock
+static void lockListing(sfs_session* session) {
+    pthread_rwlock_rdlock(&cur_fs->fs_lock);
+    if(!directoryCached(session->cur_inode)) {
+        pthread_rwlock_unlock(&cur_fs->fs_lock);
+        pthread_rwlock_wrlock(&cur_fs->fs_lock);
     }
-    strcpy(fname, cur_directory.file_inode_map[directory_iterator_index].name);
-    directory_iterator_index++;
-    return 1;
+    pthread_mutex_lock(&session->listing_lock);
+}
+
+static void unlockListing(sfs_session* session) {
+    pthread_mutex_unlock(&session->listing_lock);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
 }
 
+// The session's directory iterator, giving the entry type - return 1 on success, 0 on end of list
+int sfs_session_getnextentry(sfs_session* session, char* fname, int* is_directory) {
+    DirectoryTableEntry entry;
+    lockListing(session);
+    int next = nextDirectoryEntry(session->cur_inode, session->iterator_index, &entry, &session->listing);
+    if(next < 0) {
+        session->iterator_index = 0;
+    } else {
+        strcpy(fname, entry.name);
+        *is_directory = (entry.type == ENTRY_DIRECTORY);
+        session->iterator_index = next;
+    }
+    unlockListing(session);
+    return next >= 0;
+}
+
+
+// Read up to count entries (with metadata) of the current directory, continuing the shared iterator
+// Return number of entries read, 0 on end of list, negative on error
+int sfs_readdirplus(sfs_dirent* entries, int count) {
+    return sfs_session_readdirplus(&cur_fs->default_session, entries, count);
+}
+
+// Read up to count entries (with metadata) of the session's current directory, continuing its iterator
+// Return number of entries read, 0 on end of list, negative on error
+int sfs_session_readdirplus(sfs_session* session, sfs_dirent* entries, int count) {
+    if(entries == NULL || count <= 0) return -1;
+    DirectoryTableEntry* found = malloc(count * sizeof(DirectoryTableEntry));
+    int* inodes = malloc(count * sizeof(int));
+    iNode* nodes = malloc(count * sizeof(iNode));
+    if(found == NULL || inodes == NULL || nodes == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate directory listing memory!\n");
+        free(found);
+        free(inodes);
+        free(nodes);
+        return -1;
+    }
+
+    // Names first (read ahead a block at a time through the session's window, which the next batch continues from),
+    // then every iNode of the batch in one pass over the iNode table
+    int read = 0;
+    lockListing(session);
+    while(read < count) {
+        int next = nextDirectoryEntry(session->cur_inode, session->iterator_index, found + read, &session->listing);
+        if(next < 0) break;
+        inodes[read] = found[read].inode_index;
+        session->iterator_index = next;
+        read++;
+    }
+    if(read == 0) session->iterator_index = 0; // End of list, start over next time
+    readINodes(inodes, read, nodes);
+    unlockListing(session);
+
+    for(int i = 0; i < read; i++) {
+        strcpy(entries[i].name, found[i].name);
+        entries[i].stat = (sfs_stat) {.size = nodes[i].size, 
+                                      .is_directory = (found[i].type == ENTRY_DIRECTORY), 
+                                      .inode = found[i].inode_index, 
+                                      .link_count = nodes[i].link_count};
+    }
+    free(found);
+    free(inodes);
+    free(nodes);
+    return read;
+}
+
+
+// Helper - fill stat for the file or directory at path from root, without opening it. Only holds fs_lock shared,
+// unless a directory on the path isn't cached yet (opening it changes the fdt). Return 0 on success, -1 if missing
+static int statPath(const char* path, sfs_stat* stat) {
+    pthread_rwlock_rdlock(&cur_fs->fs_lock);
+    int inode_index = cachedPathINode(path); // Current directory untouched
+    if(inode_index == PATH_NOT_CACHED) {
+        pthread_rwlock_unlock(&cur_fs->fs_lock);
+        pthread_rwlock_wrlock(&cur_fs->fs_lock);
+        inode_index = fullPathINode(path);
+    }
+    if(inode_index >= 0) {
+        iNode node;
+        readINodes(&inode_index, 1, &node);
+        *stat = (sfs_stat) {.size = node.size, 
+                            .is_directory = node.is_directory, 
+                            .inode = inode_index, 
+                            .link_count = node.link_count};
+    }
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    return (inode_index < 0) ? -1 : 0;
+}
 
 // Return size of file in bytes - assumes the given path starts from root
 // ex. if "a3" is the currently loaded directory, we need "a3\sfs_superblock", not "sfs_superblock"
 int sfs_getfilesize(const char* path) {
-    int old_fdt_size = fdt.size; // Need to see if we should close when we're done
-    int fdt_idx = fdtOpenFullPathFile(path); // Will restore directory
-    if(fdt_idx < 0) {
-        return fdt_idx;
-    }
-    int size = fdt.inodes[fdt_idx].size;
-    if(fdt.size != old_fdt_size) closeFDTNode(fdt_idx);
-    return size;
+    sfs_stat stat;
+    if(statPath(path, &stat) < 0) return -1;
+    return (int) stat.size;
 }
 
 
 // Create a subdirectory with the given name. Return 0 on success, negative on failure
 int sfs_mkdir(char* name) {
+    return sfs_session_mkdir(&cur_fs->default_session, name);
+}
+
+// Create a subdirectory of the session's current directory. Return 0 on success, negative on failure
+int sfs_session_mkdir(sfs_session* session, char* name) {
     if(strlen(name) > MAXFILENAME) {
         return -1;
     }
-    int old_size = fdt.size;
-    int idx = openDirectoryFile(name);
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    int idx = openDirectoryFile(session->cur_inode, name);
     // If found, error. Otherwise create new
     if(idx >= 0) {
-        if(fdt.size > old_size) closeFDTNode(idx);
-        return -1;
+        closeFDTNode(idx);
+        idx = -1;
     } else {
-        idx = createDirectoryFile(name, true);
+        idx = createDirectoryFile(session->cur_inode, name, true);
+        if(idx >= 0) closeFDTNode(idx); // Cleanup, don't keep created directory in FDT
     }
-    if(idx < 0) return -1;
-    closeFDTNode(idx); // Cleanup, don't keep created directory in FDT
-    return 0;
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    return (idx < 0) ? -1 : 0;
 }
 
 
 // Changes current directory to subdirectory with the given name. Return 0 on success, negative on failure
 int sfs_loaddir(char* name) {
+    return sfs_session_loaddir(&cur_fs->default_session, name);
+}
+
+// Changes the session's current directory to its subdirectory with the given name (or ".."). Return 0 on success
+int sfs_session_loaddir(sfs_session* session, char* name) {
     if(strlen(name) > MAXFILENAME) {
         return 0;
     }
 
-    int inode_idx = cur_directory.parent_inode_index; // Default parent
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    int inode_idx = parentDirectory(session->cur_inode); // Default parent
+    int result = 0;
 
     // If not loading parent directory - load new into fdt and extract iNode index
     if(strcmp(name, "..") != 0) {
-        int fdt_idx = openDirectoryFile(name);
-        if(fdt_idx < 0) return fdt_idx;
-        inode_idx = fdt.table[fdt_idx].inode_idx;
+        int fdt_idx = openDirectoryFile(session->cur_inode, name);
+        if(fdt_idx < 0) result = fdt_idx;
+        else {
+            inode_idx = fdt.table[fdt_idx].inode_idx;
+            closeFDTNode(fdt_idx); // The directory cache opens its own handles
+        }
     }
 
-    if(inode_idx < 0 || !loadDirectory(inode_idx, true)) return -1;
-    directory_iterator_index = 0; // Restart any iterator
-    return 0;
+    if(result == 0 && (inode_idx < 0 || !loadDirectory(inode_idx, cur_fs->prefetch_on_load) || !pinDirectory(inode_idx))) result = -1;
+    if(result == 0) {
+        unpinDirectory(session->cur_inode);
+        session->cur_inode = inode_idx;
+        session->iterator_index = 0; // Restart any iterator
+    }
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    return result;
+}
+
+// Turn prefetching the iNodes of a directory's entries on sfs_loaddir on (non zero) or off
+void sfs_set_prefetch(int enabled) {
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    cur_fs->prefetch_on_load = (enabled != 0);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
 }
 
 // TODO: Load absolute path method (loaddir is relative, and only takes one at a time)
@@ -169,84 +541,328 @@ int sfs_loaddir(char* name) {
 
 // Open a file with name (create if doesn't exist). Return index in file descriptor table, or negative on error
 int sfs_fopen(char* name) {
+    return sfs_session_fopen(&cur_fs->default_session, name);
+}
+
+// Open a file of the session's current directory (create if doesn't exist). Return index in file descriptor table
+int sfs_session_fopen(sfs_session* session, char* name) {
     if(strlen(name) > MAXFILENAME) {
         return -1;
     }
-    int idx = openDirectoryFile(name);
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    int idx = openDirectoryFile(session->cur_inode, name);
 
     // If doesn't already exist
     if (idx < 0) {
-        idx = createDirectoryFile(name, false);
+        idx = createDirectoryFile(session->cur_inode, name, false);
     
     // Use specific directory functions (mkdir, loaddir, etc.) for directories.
-    } else if (fdt.inodes[idx].is_directory){ 
-        return -1;
+    } else if (fdtNode(idx)->is_directory){ 
+        closeFDTNode(idx);
+        idx = -1;
     }
+    ownHandle(session, idx);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
     return idx;
 }
 
 
-// Remove file from file descriptor table. Return 0 on success, negative on error
-int sfs_fclose(int fileID) {
-    if(fileID < 0 || fileID >= fdt.allocated || fdt.table[fileID].inode_idx < 0  || fdt.inodes[fileID].is_directory) {
+// Create new files with the given names in the current directory, all at once, and open them (ids put in fileIDs)
+// Return number of files created, negative on error (then nothing is created)
+int sfs_create_many(char** names, int count, int* fileIDs) {
+    return sfs_session_create_many(&cur_fs->default_session, names, count, fileIDs);
+}
+
+// Create new files in the session's current directory all at once, see sfs_create_many
+int sfs_session_create_many(sfs_session* session, char** names, int count, int* fileIDs) {
+    if(count < 0 || (count > 0 && (names == NULL || fileIDs == NULL))) {
         return -1;
     }
-    closeFDTNode(fileID);
-    return 0;
+    if(count == 0) return 0;
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    int created = createDirectoryFiles(session->cur_inode, names, count, fileIDs);
+    for(int i = 0; i < created; i++) ownHandle(session, fileIDs[i]);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    return created;
+}
+
+
+// Helper - whether fileID is an open file (not directory) handle
+static bool validFile(int fileID) {
+    return fileID >= 0 && fileID < fdt.allocated && fdt.table[fileID].inode_idx >= 0 && !fdtNode(fileID)->is_directory;
+}
+
+// Helper - start I/O on an open file: fs_lock shared, then the file's iNode lock (exclusive to write or move
+// the pointers). Returns false, holding nothing, if fileID isn't an open file
+static bool beginFileIO(int fileID, bool exclusive) {
+    pthread_rwlock_rdlock(&cur_fs->fs_lock);
+    if(!validFile(fileID)) {
+        pthread_rwlock_unlock(&cur_fs->fs_lock);
+        return false;
+    }
+    lockFDTNode(fileID, exclusive);
+    return true;
+}
+
+static void endFileIO(int fileID) {
+    unlockFDTNode(fileID);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+}
+
+
+// Remove file from file descriptor table. Return 0 on success, negative on error
+int sfs_fclose(int fileID) {
+    return sfs_session_fclose(&cur_fs->default_session, fileID);
+}
+
+// Close a handle the session opened. Return 0 on success, negative on error
+int sfs_session_fclose(sfs_session* session, int fileID) {
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    bool valid = validFile(fileID) && fdt.table[fileID].owner == session;
+    if(valid) closeFDTNode(fileID);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    return valid ? 0 : -1;
 }
 
 
 // Use write pointer to write to file. Return bytes written
 int sfs_fwrite(int fileID, const char* buf, int length) {
-    if(fileID < 0 || fileID >= fdt.allocated || fdt.table[fileID].inode_idx < 0 || fdt.inodes[fileID].is_directory) {
-        return -1;
-    }
-    if (length < 1) return 0;
-    int bytes_written = overwriteData(fileID, buf, length);
+    if(!beginFileIO(fileID, true)) return -1;
+    int bytes_written = (length < 1) ? 0 : overwriteData(fileID, buf, length);
     fdt.table[fileID].readPointer = fdt.table[fileID].writePointer; // Assignment required 1 read/write pointer
+    endFileIO(fileID);
     return bytes_written;
 }
 
+// Write buffered appends of the file to disk. Return 0 on success, negative on error
+int sfs_fflush(int fileID) {
+    if(!beginFileIO(fileID, true)) return -1;
+    flushFDTNode(fileID);
+    endFileIO(fileID);
+    return 0;
+}
+
+// Write buffered appends of every open file (and directory) to disk
+void sfs_sync() {
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    syncAll();
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+}
+
 // Use write pointer to delete from a file. Returns bytes deleted
 int sfs_fdelete(int fileID, int length) {
-    if(fileID < 0 || fileID >= fdt.allocated || fdt.table[fileID].inode_idx < 0 || fdt.inodes[fileID].is_directory) {
-        return -1;
-    }
-    if (length < 1) return 0;
-    int bytes_deleted = deleteData(fileID, length);
+    if(!beginFileIO(fileID, true)) return -1;
+    int bytes_deleted = (length < 1) ? 0 : deleteData(fileID, length);
     fdt.table[fileID].readPointer = fdt.table[fileID].writePointer; // Assignment required 1 read/write pointer
+    endFileIO(fileID);
     return bytes_deleted;
 }
 
 // Use read pointer to read from file. Return bytes read
 int sfs_fread(int fileID, char* buf, int length) {
-    if(fileID < 0 || fileID >= fdt.allocated || fdt.table[fileID].inode_idx < 0 || fdt.inodes[fileID].is_directory) {
-        return -1;
+    if(!beginFileIO(fileID, true)) return -1; // Moves the pointer
+    int bytes_read = (length < 1) ? 0 : readData(fileID, buf, length);
+    fdt.table[fileID].writePointer = fdt.table[fileID].readPointer; // Assignment required 1 read/write pointer
+    endFileIO(fileID);
+    return bytes_read;
+}
+
+
+// Read from file at the given byte offset, leaving the read/write pointer alone. Return bytes read
+int sfs_pread(int fileID, char* buf, int length, long offset) {
+    if (offset < 0) return -1;
+    if(!beginFileIO(fileID, false)) return -1;
+    int bytes_read = (length < 1) ? 0 : readDataAt(fileID, buf, length, offset);
+    endFileIO(fileID);
+    return bytes_read;
+}
+
+// Write to file at the given byte offset (at most the file size), leaving the read/write pointer alone. Return bytes written
+int sfs_pwrite(int fileID, const char* buf, int length, long offset) {
+    if(!beginFileIO(fileID, true)) return -1;
+    int bytes_written = -1;
+    if (offset >= 0 && offset <= fdtNode(fileID)->size) {
+        bytes_written = (length < 1) ? 0 : overwriteDataAt(fileID, buf, length, offset);
     }
-    if (length < 1) return 0;
-    int bytes_read = readData(fileID, buf, length);
+    endFileIO(fileID);
+    return bytes_written;
+}
+
+
+// Helper - check a segment list from the vectored calls is usable
+static bool validIovec(const sfs_iovec* iov, int iovcnt) {
+    if(iov == NULL || iovcnt < 0) return false;
+    for(int i = 0; i < iovcnt; i++) {
+        if(iov[i].len < 0 || (iov[i].len > 0 && iov[i].base == NULL)) return false;
+    }
+    return true;
+}
+
+// Use read pointer to read from file into each segment in turn. Return bytes read
+int sfs_freadv(int fileID, const sfs_iovec* iov, int iovcnt) {
+    if(!validIovec(iov, iovcnt)) return -1;
+    if(!beginFileIO(fileID, true)) return -1; // Moves the pointer
+    int bytes_read = readDataVecAt(fileID, iov, iovcnt, fdt.table[fileID].readPointer);
+    fdt.table[fileID].readPointer += bytes_read;
     fdt.table[fileID].writePointer = fdt.table[fileID].readPointer; // Assignment required 1 read/write pointer
+    endFileIO(fileID);
+    return bytes_read;
+}
+
+// Use write pointer to write each segment in turn to file. Return bytes written
+int sfs_fwritev(int fileID, const sfs_iovec* iov, int iovcnt) {
+    if(!validIovec(iov, iovcnt)) return -1;
+    if(!beginFileIO(fileID, true)) return -1;
+    int bytes_written = overwriteDataVecAt(fileID, iov, iovcnt, fdt.table[fileID].writePointer);
+    fdt.table[fileID].writePointer += bytes_written;
+    fdt.table[fileID].readPointer = fdt.table[fileID].writePointer; // Assignment required 1 read/write pointer
+    endFileIO(fileID);
+    return bytes_written;
+}
+
+// Read from file at the given byte offset into each segment in turn, leaving the read/write pointer alone. Return bytes read
+int sfs_preadv(int fileID, const sfs_iovec* iov, int iovcnt, long offset) {
+    if(offset < 0 || !validIovec(iov, iovcnt)) return -1;
+    if(!beginFileIO(fileID, false)) return -1;
+    int bytes_read = readDataVecAt(fileID, iov, iovcnt, offset);
+    endFileIO(fileID);
     return bytes_read;
 }
 
+// Write each segment in turn to file at the given byte offset, leaving the read/write pointer alone. Return bytes written
+int sfs_pwritev(int fileID, const sfs_iovec* iov, int iovcnt, long offset) {
+    if(offset < 0 || !validIovec(iov, iovcnt)) return -1;
+    if(!beginFileIO(fileID, true)) return -1;
+    int bytes_written = (offset > fdtNode(fileID)->size) ? -1 : overwriteDataVecAt(fileID, iov, iovcnt, offset);
+    endFileIO(fileID);
+    return bytes_written;
+}
 
-// Move read/write pointer to given loc. Return 0 on success, negative on error
-int sfs_fseek(int fileID, int loc) {
-    if(fileID < 0 || fileID >= fdt.allocated || fdt.table[fileID].inode_idx < 0 || fdt.inodes[fileID].is_directory) {
+// Copy length bytes between two open files at the given offsets, leaving pointers alone. Return bytes copied
+long sfs_copy_file_range(int src_fileID, long src_offset, int dst_fileID, long dst_offset, long length) {
+    if(src_offset < 0 || dst_offset < 0) return -1;
+    pthread_rwlock_rdlock(&cur_fs->fs_lock);
+    if(!validFile(src_fileID) || !validFile(dst_fileID)) {
+        pthread_rwlock_unlock(&cur_fs->fs_lock);
         return -1;
     }
-    if (loc < 0 || loc >= fdt.inodes[fileID].size) {
-        return -1;
+    lockFDTNodePair(src_fileID, dst_fileID);
+    long copied = -1;
+    // Overlapping ranges of one file would read back bytes already overwritten
+    bool overlap = fdt.table[src_fileID].inode_idx == fdt.table[dst_fileID].inode_idx 
+                   && src_offset < dst_offset + length && dst_offset < src_offset + length;
+    if(dst_offset <= fdtNode(dst_fileID)->size && !overlap) {
+        copied = (length < 1) ? 0 : copyDataAt(src_fileID, src_offset, dst_fileID, dst_offset, length);
     }
-    fdt.table[fileID].readPointer = loc;
-    fdt.table[fileID].writePointer = loc;
-    return 0;
+    unlockFDTNodePair(src_fileID, dst_fileID);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    return copied;
+}
+
+
+// Move read/write pointer to given loc. Return 0 on success, negative on error
+int sfs_fseek(int fileID, int loc) {
+    if(!beginFileIO(fileID, true)) return -1;
+    bool in_file = (loc >= 0 && loc < fdtNode(fileID)->size);
+    if(in_file) {
+        fdt.table[fileID].readPointer = loc;
+        fdt.table[fileID].writePointer = loc;
+    }
+    endFileIO(fileID);
+    return in_file ? 0 : -1;
 }
 
 // Delete a file or directory. Return 0 on success, negative on error
 int sfs_remove(char* file) {
-    DirectoryTableEntry old_file = removeDirectoryFile(file);
+    return sfs_session_remove(&cur_fs->default_session, file);
+}
+
+// Delete a file or directory of the session's current directory. Return 0 on success, negative on error
+int sfs_session_remove(sfs_session* session, char* file) {
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    DirectoryTableEntry old_file = removeDirectoryFile(session->cur_inode, file);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
     if(old_file.inode_index < 0) return -1;
     return 0;
 }
 
+// Free the space of up to max_files removed files (all if negative). Return number freed
+int sfs_reclaim(int max_files) {
+    pthread_rwlock_rdlock(&cur_fs->fs_lock); // Orphans have no handles, only the allocator is shared
+    int reclaimed = reclaimOrphans(max_files);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    return reclaimed;
+}
+
+
+// Open a file by path from root (create if doesn't exist). Return index in file descriptor table, or negative on error
+int sfs_open_path(const char* path) {
+    return sfs_session_open_path(&cur_fs->default_session, path);
+}
+
+// Open a file by path from root for the session (create if doesn't exist). Return index in file descriptor table
+int sfs_session_open_path(sfs_session* session, const char* path) {
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    int idx = fdtOpenFullPathFile(path);
+
+    // If doesn't already exist
+    if (idx < 0) {
+        idx = createPathFile(path, false);
+
+    // Use specific directory functions for directories.
+    } else if (fdtNode(idx)->is_directory) {
+        closeFDTNode(idx);
+        idx = -1;
+    }
+    ownHandle(session, idx);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    return idx;
+}
+
+// Fill stat with metadata of file or directory at path from root. Return 0 on success, negative on failure
+int sfs_stat_path(const char* path, sfs_stat* stat) {
+    return statPath(path, stat);
+}
+
+// Create a directory by path from root. Return 0 on success, negative on failure
+int sfs_mkdir_path(const char* path) {
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    int idx = createPathFile(path, true);
+    if(idx >= 0) closeFDTNode(idx); // Cleanup, don't keep created directory in FDT
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    return (idx < 0) ? -1 : 0;
+}
+
+// Delete a file or directory by path from root. Return 0 on success, negative on error
+int sfs_remove_path(const char* path) {
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    DirectoryTableEntry old_file = removePathFile(path);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    if(old_file.inode_index < 0) return -1;
+    return 0;
+}
+
+// Rename or move a file or directory by paths from root (replacing a file there). Return 0 on success, negative on error
+int sfs_rename(const char* old_path, const char* new_path) {
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    bool renamed = renamePathFile(old_path, new_path);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    return renamed ? 0 : -1;
+}
+
+// Clone a file by paths from root, sharing its data blocks until either is written. Return 0 on success, negative on error
+int sfs_clone(const char* src_path, const char* new_path) {
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    int idx = clonePathFile(src_path, new_path);
+    if(idx >= 0) closeFDTNode(idx);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    return (idx < 0) ? -1 : 0;
+}
+
+// Add new_path as another name (hard link) of the file at existing_path. Return 0 on success, negative on error
+int sfs_link(const char* existing_path, const char* new_path) {
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    bool linked = linkPathFile(existing_path, new_path);
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+    return linked ? 0 : -1;
+}
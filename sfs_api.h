@@ -1,11 +1,66 @@
 #ifndef SFS_API_H
 #define SFS_API_H
 
-#define MAXFILENAME 20
+#define MAXFILENAME 255
+
+// One buffer segment for the vectored read/write functions (sfs_freadv, sfs_fwritev, ...)
+typedef struct sfs_iovec {
+    void* base; // Start of the segment
+    long len;   // Size of the segment in bytes
+} sfs_iovec;
+
+// Metadata of a file or directory, filled by sfs_stat_path
+typedef struct sfs_stat {
+    long size;        // Size in bytes
+    int is_directory; // 1 for a directory, 0 for a file
+    int inode;        // iNode index (unique among existing files)
+    int link_count;   // Directory entries referring to the iNode
+} sfs_stat;
+
+// One directory entry with the metadata of its file, filled by sfs_readdirplus
+typedef struct sfs_dirent {
+    char name[MAXFILENAME + 1];
+    sfs_stat stat;
+} sfs_dirent;
+
+// A client's own current directory, directory listing position and open handles (see sfs_session_open)
+typedef struct sfs_session sfs_session;
+
+// A read or write running in the background (see sfs_read_async)
+typedef struct sfs_async sfs_async;
+
+// Called (on an internal thread) when a background read or write is done. result is what sfs_pread or sfs_pwrite
+// would have returned, request is freed once the callback returns
+typedef void (*sfs_async_callback)(sfs_async* request, int result, void* context);
+
+// A background read or write taken off the completion queue by sfs_async_reap
+typedef struct sfs_async_completion {
+    sfs_async* request; // As returned when it was started (already freed, only to tell requests apart)
+    int result;         // Bytes read or written, negative on error
+    void* context;      // As given when it was started
+} sfs_async_completion;
+
+// Creates, writes, removes and renames queued to run together (see sfs_batch_open)
+typedef struct sfs_batch sfs_batch;
+
+// One file system image mounted in the process (see sfs_mount)
+typedef struct sfs_t sfs_t;
+
+// How sfs_mount mounts an image. Sizes are only used to create a new file system, 0 picks the default
+typedef struct sfs_options {
+    int fresh;              // 1 to create a new file system in the image, 0 to load the one it holds
+    int block_size;         // Bytes in a block (default 1024)
+    int file_system_size;   // Blocks in the image (default 1024)
+    int inode_table_length; // Blocks holding iNodes (default 48)
+} sfs_options;
 
 // NOTE: Functions like fread, fwrite, fseek, fopen/fclose, and fdelete can not be used on directories.
 //       Use specialized directory functions instead (mkdir, loaddir, remove, etc.)
 
+// NOTE: Every function may be called from several threads at once. Reads and writes of open files (fread, pwrite,
+//       copy_file_range, ...) run in parallel unless they use the same file, as do listings and lookups (getnextentry,
+//       readdirplus, getfilesize, stat_path) of directories already cached. Other calls run one at a time
+
 /* Formats the disk emulator virtual disk, and creates the simple file system 
 *  instance on it.
 *  Parameters:
@@ -14,6 +69,39 @@
 void mksfs(int fresh);
 
 
+/* Mounts a file system image of its own, alongside the default one (fs.sfs) and any others, each with its own
+*  super block, open files, caches and locks. Calls work on the calling thread's file system: pick this one with
+*  sfs_use. mksfs then recreates or reloads this image, and file IDs and sessions belong to the file system they
+*  were opened in.
+*  Parameters:
+*      path               (const char*): image file (created if fresh)
+*      options    (const sfs_options*): NULL to load an existing image
+*  Return:
+*      fs (sfs_t*): the mounted file system, NULL if the image can't be created or loaded (or the sizes don't fit:
+*                   a block of at least 512 bytes must hold a bit per iNode and data block)
+*/
+sfs_t* sfs_mount(const char* path, const sfs_options* options);
+
+
+/* Saves and unmounts a file system from sfs_mount, closing its open files and sessions. The calling thread goes
+*  back to the default file system if it was using this one, other threads must stop using it first.
+*  Asynchronous requests started on it are waited for (their callbacks too, so don't unmount from one).
+*  Parameters:
+*      fs (sfs_t*): file system to unmount (NULL or the default one is ignored)
+*/
+void sfs_unmount(sfs_t* fs);
+
+
+/* Picks the file system every later call of the calling thread works on. File systems used by different threads
+*  run in parallel, each only locks its own.
+*  Parameters:
+*      fs (sfs_t*): mounted file system, NULL for the default one
+*  Return:
+*      previous (sfs_t*): the file system the thread used before (pass it back to sfs_use to return to it)
+*/
+sfs_t* sfs_use(sfs_t* fs);
+
+
 /* Find next directory file. Used to loop through files in directory.
 *  Return 1 if next file read, 0 on end of list. 
 *  Parameters:
@@ -24,6 +112,29 @@ void mksfs(int fresh);
 int sfs_getnextfilename(char* fname);
 
 
+/* Find next directory entry, like sfs_getnextfilename (the two share one position in the directory), 
+*  also giving its type. The type is kept in the directory, so no iNode has to be read.
+*  Parameters:
+*      fname        (char*): buffer to save file name in (MAXFILENAME + 1 bytes)
+*      is_directory  (int*): set to 1 if the entry is a subdirectory, 0 if it is a file
+*  Return:
+*      success (bool): Whether an entry was read (vs. reached end of directory)
+*/
+int sfs_getnextentry(char* fname, int* is_directory);
+
+
+/* Read the next entries of the currently loaded directory together with their metadata (like sfs_stat_path
+*  on each). Shares its position in the directory with sfs_getnextfilename. The iNodes of a batch are read in 
+*  iNode table order, so a long listing reads each table block once instead of resolving a path per entry.
+*  Parameters:
+*      entries (sfs_dirent*): buffer to save the entries in
+*      count           (int): Most entries to read
+*  Return:
+*      read (int): Number of entries read, 0 at the end of the directory (the next call starts over), negative if error
+*/
+int sfs_readdirplus(sfs_dirent* entries, int count);
+
+
 /* Return the size of a file.
 *  Parameters:
 *      path (char*): Path of file to find size of
@@ -51,11 +162,101 @@ int sfs_mkdir(char* name);
 */
 int sfs_loaddir(char* name);
 
-// TODO: Move & copy file/directory (use implemented fuctions and test)
+
+/* Turn iNode prefetching for sfs_loaddir on or off (off by default). When on, loading a directory also
+*  reads the iNodes of all its entries into the iNode cache (each table block once, neighbouring blocks together),
+*  so opening or getting the metadata of its files afterwards mostly avoids disk reads.
+*  Parameters:
+*      enabled (int): 1 to prefetch, 0 not to
+*/
+void sfs_set_prefetch(int enabled);
+
+// TODO: Copy a directory tree (files are moved with sfs_rename and copied with sfs_clone, neither copies directories)
+
+
+/* The *_path functions take a path from the root directory, with names separated by '\\' 
+*  (ex. "docs\\notes\\a.txt"), the same as sfs_getfilesize. They never change the currently loaded
+*  directory, and recently used directories and path names are cached in memory.
+*/
+
+/* Open a file by path (create it, with size 0, if it does not exist). See sfs_fopen.
+*  Parameters:
+*      path (char*): Path of file to open, every directory on it must exist
+*  Return:
+*      fileID (int): File descriptor table index of the opened file (negative on error)
+*/
+int sfs_open_path(const char* path);
+
+
+/* Get metadata of a file or directory by path.
+*  Parameters:
+*      path  (char*): Path of file or directory
+*      stat (sfs_stat*): Filled with the metadata
+*  Return:
+*      success (int): 0 if succesful, negative if error
+*/
+int sfs_stat_path(const char* path, sfs_stat* stat);
+
+
+/* Create a directory by path. Error if the name is already taken. See sfs_mkdir.
+*  Parameters:
+*      path (char*): Path of new directory, every directory above it must exist
+*  Return:
+*      success (int): 0 if succesful, negative if error
+*/
+int sfs_mkdir_path(const char* path);
+
+
+/* Delete a file or directory by path. See sfs_remove. The loaded directory (or one above it) can't be deleted.
+*  Parameters:
+*      path (char*): Path of file or directory to be deleted
+*  Return:
+*      success (int): 0 if succesful, negative if error
+*/
+int sfs_remove_path(const char* path);
+
+
+/* Rename or move a file or directory by path, within or across directories. If new_path already names a
+*  file it is replaced (it is removed, see sfs_remove), the same for an empty directory when moving a directory.
+*  Only the two directory entries are rewritten: no file data is copied and open files stay open. 
+*  A directory can't be moved under itself.
+*  Parameters:
+*      old_path (char*): Path of file or directory to rename
+*      new_path (char*): Path to give it, every directory above it must exist
+*  Return:
+*      success (int): 0 if succesful, negative if error
+*/
+int sfs_rename(const char* old_path, const char* new_path);
+
+
+/* Clone a file by path: the clone has the same contents but shares the file's data blocks (each block keeps
+*  a count of the files using it) instead of copying them. A shared block is only copied when one of the files
+*  writes or deletes data in it, and is freed once no file uses it. Cloning a large file is cheap in time and space.
+*  Parameters:
+*      src_path (char*): Path of the file to clone
+*      new_path (char*): Path of the clone, must not exist yet (every directory above it must)
+*  Return:
+*      success (int): 0 if succesful, negative if error
+*/
+int sfs_clone(const char* src_path, const char* new_path);
+
+
+/* Add another name for a file (a hard link): both paths refer to the same file, so writes through either are
+*  seen through the other and no data is copied. Removing a name takes away one link, the file (and its space)
+*  only goes with its last link. sfs_stat_path reports the number of links. Directories can't be linked.
+*  Parameters:
+*      existing_path (char*): Path of the file to link to
+*      new_path      (char*): New name for it, must not exist yet (every directory above it must)
+*  Return:
+*      success (int): 0 if succesful, negative if error
+*/
+int sfs_link(const char* existing_path, const char* new_path);
+
 
 /* Open a file (load iNode to cache) and return index of file descriptor table entry.
 *  If a file does not exist, it will be created with size 0.
 *  File by default opens with the write pointer at the end of the file (writes will append).
+*  Every call gives a new handle with its own read/write pointer, handles on one file share its iNode.
 *  Parameters:
 *      name (char*): Name of file to open
 *  Return:
@@ -64,7 +265,21 @@ int sfs_loaddir(char* name);
 int sfs_fopen(char* name);
 
 
-/* Close a file, removing it from the file descriptor table.
+/* Create several new files in the currently loaded directory at once and open them. See sfs_fopen.
+*  Their iNodes and directory entries are written together, so this is much faster than one sfs_fopen per file.
+*  Nothing is created if a name is too long, already taken or repeated, or if there is not space for every file.
+*  Parameters:
+*      names  (char**): Names of the new files
+*      count     (int): Number of names
+*      fileIDs  (int*): Filled with the file descriptor table index of each new file (in the order of names)
+*  Return:
+*      created   (int): Number of files created (count), negative if error
+*/
+int sfs_create_many(char** names, int count, int* fileIDs);
+
+
+/* Close a file handle, removing it from the file descriptor table. Other handles on the file stay open.
+*  Handles opened through a session are closed with sfs_session_fclose instead.
 *  Parameters:
 *      fileID  (int): Index of file descriptor table entry to remove
 *  Return:
@@ -83,6 +298,22 @@ int sfs_fclose(int fileID);
 */
 int sfs_fwrite(int fileID, const char* buf, int length);
 
+
+/* Write any buffered appends of an opened file to disk. Small appends are held in memory
+*  until their block fills, the file is closed, or this (or sfs_sync) is called.
+*  Parameters:
+*      fileID  (int): File index in file descriptor table
+*  Return:
+*      success (int): 0 if succesful, negative if error
+*/
+int sfs_fflush(int fileID);
+
+
+/* Write buffered appends of every open file to disk.
+*/
+void sfs_sync();
+
+
 /* Delete data from an opened file (data just before the current location of the read/write pointer).
 *  Parameters:
 *      fileID   (int): File index in file descriptor table
@@ -104,6 +335,138 @@ int sfs_fdelete(int fileID, int length);
 int sfs_fread(int fileID, char* buf, int length);
 
 
+/* Read an opened file at the given byte offset. The read/write pointer is not used or moved.
+*  Parameters:
+*      fileID   (int): File index in file descriptor table
+*      buffer (char*): Buffer to save read data within
+*      length   (int): Number of bytes to read
+*      offset  (long): Byte location in the file to start reading from
+*  Return:
+*      length   (int): Number of bytes read (negative on error)
+*/
+int sfs_pread(int fileID, char* buf, int length, long offset);
+
+
+/* Write to an opened file at the given byte offset (overwriting). The offset may be at most
+*  the file size, where the write appends. The read/write pointer is not used or moved.
+*  Parameters:
+*      fileID   (int): File index in file descriptor table
+*      buffer (char*): Buffer of data to be written
+*      length   (int): Number of bytes to write (size of buffer)
+*      offset  (long): Byte location in the file to start writing at
+*  Return:
+*      length   (int): Number of bytes written (negative on error)
+*/
+int sfs_pwrite(int fileID, const char* buf, int length, long offset);
+
+
+/* Read an opened file (at the current location of the read/write pointer) into several buffers,
+*  filling each segment in turn. The file's blocks are looked up once for the whole read.
+*  Parameters:
+*      fileID          (int): File index in file descriptor table
+*      iov    (sfs_iovec*): Segments (buffer & size) to save read data within
+*      iovcnt          (int): Number of segments
+*  Return:
+*      length          (int): Number of bytes read (negative on error)
+*/
+int sfs_freadv(int fileID, const sfs_iovec* iov, int iovcnt);
+
+
+/* Write several buffers to an opened file (at the current location of the read/write pointer),
+*  one after the other. The file's blocks are looked up once and its iNode saved once for the whole write.
+*  Parameters:
+*      fileID          (int): File index in file descriptor table
+*      iov    (sfs_iovec*): Segments (buffer & size) of data to be written
+*      iovcnt          (int): Number of segments
+*  Return:
+*      length          (int): Number of bytes written (negative on error)
+*/
+int sfs_fwritev(int fileID, const sfs_iovec* iov, int iovcnt);
+
+
+/* Positional version of sfs_freadv, see sfs_pread. The read/write pointer is not used or moved.
+*  Parameters:
+*      fileID          (int): File index in file descriptor table
+*      iov    (sfs_iovec*): Segments (buffer & size) to save read data within
+*      iovcnt          (int): Number of segments
+*      offset         (long): Byte location in the file to start reading from
+*  Return:
+*      length          (int): Number of bytes read (negative on error)
+*/
+int sfs_preadv(int fileID, const sfs_iovec* iov, int iovcnt, long offset);
+
+
+/* Positional version of sfs_fwritev, see sfs_pwrite. The read/write pointer is not used or moved.
+*  Parameters:
+*      fileID          (int): File index in file descriptor table
+*      iov    (sfs_iovec*): Segments (buffer & size) of data to be written
+*      iovcnt          (int): Number of segments
+*      offset         (long): Byte location in the file to start writing at (at most the file size)
+*  Return:
+*      length          (int): Number of bytes written (negative on error)
+*/
+int sfs_pwritev(int fileID, const sfs_iovec* iov, int iovcnt, long offset);
+
+
+/* Copy bytes from one open file to another inside the file system (like copy_file_range): the data is
+*  streamed in block runs through a small fixed size buffer, so even a large copy needs little memory.
+*  Read/write pointers are left alone. The two ranges may be in the same file if they don't overlap.
+*  Parameters:
+*      src_fileID   (int): File index in file descriptor table to copy from
+*      src_offset  (long): Byte offset in the source to start at
+*      dst_fileID   (int): File index in file descriptor table to copy to
+*      dst_offset  (long): Byte offset in the destination to start at, at most its size
+*      length      (long): Number of bytes to copy (fewer are copied past the end of the source)
+*  Return:
+*      copied      (long): Number of bytes copied (negative on error)
+*/
+long sfs_copy_file_range(int src_fileID, long src_offset, int dst_fileID, long dst_offset, long length);
+
+
+/* Start a positional read (like sfs_pread) that runs on an internal thread, and return at once. Many can be
+*  in flight: requests on different files, or reading one file, run in parallel, in no particular order. The
+*  buffer must stay valid until the request is done. It runs on the file system the calling thread uses.
+*  Parameters:
+*      fileID                    (int): File index in file descriptor table
+*      buf                     (char*): Buffer to fill
+*      length                    (int): Number of bytes to read
+*      offset                   (long): Byte offset in the file to start at
+*      callback (sfs_async_callback): Called when done, NULL to put the request on the completion queue instead
+*      context                 (void*): Given back to the callback or in the completion
+*  Return:
+*      request (sfs_async*): Handle of the request (NULL if it can't be started)
+*/
+sfs_async* sfs_read_async(int fileID, char* buf, int length, long offset, sfs_async_callback callback, void* context);
+
+
+/* Start a positional write (like sfs_pwrite) that runs on an internal thread, and return at once. Wait for a
+*  write to be done before starting a request that depends on it (requests can run in any order).
+*  Parameters and return as in sfs_read_async (buf holds the data to write)
+*/
+sfs_async* sfs_write_async(int fileID, const char* buf, int length, long offset, sfs_async_callback callback,
+                           void* context);
+
+
+/* Take done requests (started without a callback) off the completion queue, oldest first.
+*  Parameters:
+*      completions (sfs_async_completion*): Buffer to save the done requests in
+*      max                           (int): Most requests to take
+*      wait                          (int): 1 to wait for at least one if none are done (returns 0 at once if
+*                                          no request without a callback is in flight)
+*  Return:
+*      reaped (int): Number of requests taken (negative on error)
+*/
+int sfs_async_reap(sfs_async_completion* completions, int max, int wait);
+
+
+/* File descriptor that is readable (poll, select, epoll) while the completion queue isn't empty, so an event
+*  loop can wait for requests along with its other events. Only sfs_async_reap empties it, don't read it.
+*  Return:
+*      fd (int): The descriptor (negative on error)
+*/
+int sfs_async_fd();
+
+
 /* Move read/write pointer to the given location.
 *  Parameters:
 *      fileID  (int): File index in file descriptor table
@@ -114,7 +477,7 @@ int sfs_fread(int fileID, char* buf, int length);
 int sfs_fseek(int fileID, int loc);
 
 
-/* Delete a file or directory from the current SFS directory.
+/* Delete a file or directory from the current SFS directory. Open handles on a deleted file are closed.
 *  Parameters:
 *      file (char*): Name of file to be deleted
 *  Return:
@@ -122,4 +485,106 @@ int sfs_fseek(int fileID, int loc);
 */
 int sfs_remove(char* file);
 
+
+/* Free the space of files removed earlier. Removing a file (or directory) only takes it out of its directory
+*  and puts it on an orphan list kept on disk, its space is freed later: a batch at a time by a background
+*  thread of the file system (also for files left on the list by the last shutdown or a crash, once loaded),
+*  a batch at a time by a write finding the disk or iNodes full, or by this call.
+*  Parameters:
+*      max_files (int): Most removed files to free (negative for all)
+*  Return:
+*      freed (int): Number of removed files whose space was freed
+*/
+int sfs_reclaim(int max_files);
+
+/* Sessions let several clients (ex. the users of one server) each have their own current directory, directory
+*  listing position and open handles. The calls above without a session all use one default session.
+*  A session's handles work with every call taking a fileID (sfs_fread, sfs_pwrite, ...), but only the session
+*  that opened a handle can close it. The current directory of any session (or a directory above it) can't be removed.
+*  Sessions start over in the root directory when mksfs is called.
+*/
+
+/* Start a new session, in the root directory. Call after mksfs.
+*  Return:
+*      session (sfs_session*): The new session (NULL on error)
+*/
+sfs_session* sfs_session_open();
+
+
+/* End a session, closing the handles it still has open. The default session can't be closed.
+*  It can be called from any thread, whichever file system that thread uses.
+*  Parameters:
+*      session (sfs_session*): Session to end
+*/
+void sfs_session_close(sfs_session* session);
+
+
+/* Session versions of sfs_loaddir, sfs_getnextentry, sfs_readdirplus, sfs_mkdir, sfs_fopen, sfs_create_many,
+*  sfs_open_path, sfs_fclose and sfs_remove. Names are relative to the session's current directory, 
+*  listings continue the session's position, and opened handles belong to the session.
+*  Parameters:
+*      session (sfs_session*): Session making the call
+*      (the others as in the calls without a session)
+*/
+int sfs_session_loaddir(sfs_session* session, char* name);
+int sfs_session_getnextentry(sfs_session* session, char* fname, int* is_directory);
+int sfs_session_readdirplus(sfs_session* session, sfs_dirent* entries, int count);
+int sfs_session_mkdir(sfs_session* session, char* name);
+int sfs_session_fopen(sfs_session* session, char* name);
+int sfs_session_create_many(sfs_session* session, char** names, int count, int* fileIDs);
+int sfs_session_open_path(sfs_session* session, const char* path);
+int sfs_session_fclose(sfs_session* session, int fileID);
+int sfs_session_remove(sfs_session* session, char* file);
+
+
+/* Start an empty batch. Operations queued in it (by path from root) only run when it is submitted, all in one
+*  call: iNode table, free bit map and super block changes are held in memory and each changed block is written
+*  once, before the batch next changes a directory or at the end. Consecutive creates in one directory add their
+*  entries together (as sfs_create_many). Queued paths and data are copied, so the caller's buffers can be reused.
+*  A crash part way through a batch leaves the directory tree as the same operations without a batch could: every
+*  entry on disk refers to an iNode and blocks on disk, and blocks freed by the batch aren't reused until the iNodes
+*  that referred to them are written. Operations not reached yet are lost, as can be data written by the batch, and
+*  the space of a file removed just before the crash may stay in use.
+*  Return:
+*      batch (sfs_batch*): The new batch (NULL on error)
+*/
+sfs_batch* sfs_batch_open();
+
+
+/* Queue operations in a batch (run in the order queued): create an empty file (fails if the path is taken), write
+*  to a file at a byte offset (at most its size, the file is created if missing), remove a file or directory, or
+*  rename (move) one as sfs_rename does.
+*  Parameters:
+*      batch (sfs_batch*): Batch to queue in
+*      path (const char*): Path from root of the file (old_path the one to rename, new_path its new path)
+*      buf  (const char*): Data to write
+*      length       (int): Number of bytes to write
+*      offset      (long): Byte offset in the file to write at
+*  Return:
+*      success (int): 0 if queued, negative if error
+*/
+int sfs_batch_create(sfs_batch* batch, const char* path);
+int sfs_batch_write(sfs_batch* batch, const char* path, const char* buf, int length, long offset);
+int sfs_batch_remove(sfs_batch* batch, const char* path);
+int sfs_batch_rename(sfs_batch* batch, const char* old_path, const char* new_path);
+
+
+/* Run the queued operations in order on the calling thread's file system, then empty the batch (to queue more).
+*  No other call runs until they are done. An operation that fails doesn't stop the others.
+*  Parameters:
+*      batch (sfs_batch*): Batch to submit
+*      results     (int*): Result of each operation, in order (0, or bytes written for a write, negative if it
+*                          failed), NULL if not needed
+*  Return:
+*      succeeded (int): Number of operations that succeeded (negative on error)
+*/
+int sfs_batch_submit(sfs_batch* batch, int* results);
+
+
+/* Free a batch, dropping any operations not submitted.
+*  Parameters:
+*      batch (sfs_batch*): Batch to free
+*/
+void sfs_batch_close(sfs_batch* batch);
+
 #endif
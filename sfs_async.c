@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "sfs_api.h"
+#include "sfs_instance.h"
+
+// Threads running asynchronous requests (started by the first request). Requests on different files (or reads of
+// one file) run in parallel, as sfs_pread & sfs_pwrite from that many threads would
+#define ASYNC_WORKERS 4
+
+// A read or write waiting for a worker, being run, or done and waiting to be reaped
+struct sfs_async {
+    sfs_t* fs;       // File system of the thread that started it
+    int fileID;
+    char* buf;
+    int length;
+    long offset;
+    bool write;
+    sfs_async_callback callback; // NULL to go on the completion queue
+    void* context;
+    int result;
+    sfs_async* next; // Next request in its queue
+};
+
+// Requests not started yet, and requests done (without callback) not reaped yet. Both first in first out
+static sfs_async* pending_head = NULL;
+static sfs_async* pending_tail = NULL;
+static sfs_async* done_head = NULL;
+static sfs_async* done_tail = NULL;
+static int unreaped = 0; // Requests without callback started but not reaped yet
+
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER; // Held while using the queues
+static pthread_cond_t pending_cond = PTHREAD_COND_INITIALIZER; // A request was queued
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;    // A request went on the completion queue
+static pthread_cond_t ran_cond = PTHREAD_COND_INITIALIZER;     // A request was run (its fs has one less in flight)
+
+// Holds one byte while the completion queue isn't empty, so an event loop can wait for it with poll or select
+static int notify_pipe[2] = {-1, -1};
+static bool workers_started = false;
+
+
+// Helper - put a request at the end of a queue
+static void enqueue(sfs_async** head, sfs_async** tail, sfs_async* request) {
+    request->next = NULL;
+    if(*tail == NULL) *head = request;
+    else (*tail)->next = request;
+    *tail = request;
+}
+
+// Helper - take the request at the start of a (non empty) queue
+static sfs_async* dequeue(sfs_async** head, sfs_async** tail) {
+    sfs_async* request = *head;
+    *head = request->next;
+    if(*head == NULL) *tail = NULL;
+    return request;
+}
+
+// Helper - run queued requests forever, on the file system each was started in
+static void* runAsyncWorker(void* arg) {
+    (void) arg;
+    pthread_mutex_lock(&async_lock);
+    while(true) {
+        while(pending_head == NULL) pthread_cond_wait(&pending_cond, &async_lock);
+        sfs_async* request = dequeue(&pending_head, &pending_tail);
+        pthread_mutex_unlock(&async_lock);
+
+        sfs_t* fs = request->fs;
+        sfs_use(fs);
+        if(request->write) request->result = sfs_pwrite(request->fileID, request->buf, request->length, request->offset);
+        else request->result = sfs_pread(request->fileID, request->buf, request->length, request->offset);
+
+        if(request->callback != NULL) {
+            request->callback(request, request->result, request->context);
+            free(request);
+            pthread_mutex_lock(&async_lock);
+            fs->async_requests--;
+            pthread_cond_broadcast(&ran_cond);
+            continue;
+        }
+        pthread_mutex_lock(&async_lock);
+        fs->async_requests--;
+        pthread_cond_broadcast(&ran_cond);
+        if(done_head == NULL) {
+            char signal = 1;
+            if(write(notify_pipe[1], &signal, 1) != 1) fprintf(stderr, "ERROR: Unable to signal an asynchronous completion!\n");
+        }
+        enqueue(&done_head, &done_tail, request);
+        pthread_cond_broadcast(&done_cond);
+    }
+    return NULL;
+}
+
+// Helper - make the notify pipe and start the workers if not done yet, async_lock held. Returns success
+static bool startWorkers() {
+    if(workers_started) return true;
+    if(pipe(notify_pipe) < 0) {
+        fprintf(stderr, "ERROR: Unable to create asynchronous completion pipe!\n");
+        return false;
+    }
+    for(int i = 0; i < 2; i++) {
+        fcntl(notify_pipe[i], F_SETFL, fcntl(notify_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(notify_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    int started = 0;
+    for(int i = 0; i < ASYNC_WORKERS; i++) {
+        pthread_t worker;
+        if(pthread_create(&worker, NULL, runAsyncWorker, NULL) != 0) continue;
+        pthread_detach(worker);
+        started++;
+    }
+    if(started == 0) {
+        fprintf(stderr, "ERROR: Unable to start asynchronous I/O threads!\n");
+        close(notify_pipe[0]);
+        close(notify_pipe[1]);
+        notify_pipe[0] = notify_pipe[1] = -1;
+        return false;
+    }
+    workers_started = true;
+    return true;
+}
+
+// Helper - queue a read or write for the workers. Returns the request, NULL on error
+static sfs_async* submitAsync(int fileID, char* buf, int length, long offset, bool is_write,
+                              sfs_async_callback callback, void* context) {
+    if(buf == NULL || length < 0 || offset < 0) return NULL;
+    sfs_async* request = malloc(sizeof(sfs_async));
+    if(request == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate asynchronous request memory!\n");
+        return NULL;
+    }
+    *request = (sfs_async) {.fs = cur_fs, .fileID = fileID, .buf = buf, .length = length, .offset = offset,
+                            .write = is_write, .callback = callback, .context = context, .result = -1, .next = NULL};
+    pthread_mutex_lock(&async_lock);
+    if(!startWorkers()) {
+        pthread_mutex_unlock(&async_lock);
+        free(request);
+        return NULL;
+    }
+    if(callback == NULL) unreaped++;
+    cur_fs->async_requests++;
+    enqueue(&pending_head, &pending_tail, request);
+    pthread_cond_signal(&pending_cond);
+    pthread_mutex_unlock(&async_lock);
+    return request;
+}
+
+// Start reading from file at the given byte offset, see sfs_api.h. Returns the request, NULL on error
+sfs_async* sfs_read_async(int fileID, char* buf, int length, long offset, sfs_async_callback callback, void* context) {
+    return submitAsync(fileID, buf, length, offset, false, callback, context);
+}
+
+// Start writing to file at the given byte offset, see sfs_api.h. Returns the request, NULL on error
+sfs_async* sfs_write_async(int fileID, const char* buf, int length, long offset, sfs_async_callback callback,
+                           void* context) {
+    return submitAsync(fileID, (char*) buf, length, offset, true, callback, context);
+}
+
+// Wait until every request started on fs has run, sfs_unmount calls this before taking fs down. Done requests
+// waiting to be reaped don't refer to fs any more
+void waitAsyncRequests(sfs_t* fs) {
+    pthread_mutex_lock(&async_lock);
+    while(fs->async_requests > 0) pthread_cond_wait(&ran_cond, &async_lock);
+    pthread_mutex_unlock(&async_lock);
+}
+
+// Take up to max done requests off the completion queue (waiting for one if wait). Return number taken
+int sfs_async_reap(sfs_async_completion* completions, int max, int wait) {
+    if(completions == NULL || max < 0) return -1;
+    pthread_mutex_lock(&async_lock);
+    while(wait && done_head == NULL && unreaped > 0) pthread_cond_wait(&done_cond, &async_lock);
+    int reaped = 0;
+    while(reaped < max && done_head != NULL) {
+        sfs_async* request = dequeue(&done_head, &done_tail);
+        completions[reaped++] = (sfs_async_completion) {.request = request, .result = request->result,
+                                                        .context = request->context};
+        free(request);
+    }
+    unreaped -= reaped;
+    if(reaped > 0 && done_head == NULL) {
+        char signal;
+        if(read(notify_pipe[0], &signal, 1) != 1) fprintf(stderr, "ERROR: Unable to clear asynchronous completion signal!\n");
+    }
+    pthread_mutex_unlock(&async_lock);
+    return reaped;
+}
+
+// File descriptor readable while the completion queue isn't empty. Return -1 on error
+int sfs_async_fd() {
+    pthread_mutex_lock(&async_lock);
+    int fd = startWorkers() ? notify_pipe[0] : -1;
+    pthread_mutex_unlock(&async_lock);
+    return fd;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "sfs_api.h"
+#include "sfs_instance.h"
+#include "sfs_directory.h"
+#include "sfs_inode.h"
+
+#define BATCH_CREATE 0
+#define BATCH_WRITE 1
+#define BATCH_REMOVE 2
+#define BATCH_RENAME 3
+
+// One queued operation. Paths and data are copies, the caller's buffers can be reused at once
+typedef struct BatchOp {
+    int type;       // BATCH_CREATE, BATCH_WRITE, BATCH_REMOVE or BATCH_RENAME
+    char* path;
+    char* new_path; // BATCH_RENAME only
+    char* data;     // BATCH_WRITE only
+    int length;
+    long offset;
+} BatchOp;
+
+struct sfs_batch {
+    BatchOp* ops;
+    int count;
+    int allocated;
+};
+
+
+// Start an empty batch. Return NULL on error
+sfs_batch* sfs_batch_open() {
+    sfs_batch* batch = calloc(1, sizeof(sfs_batch));
+    if(batch == NULL) fprintf(stderr, "ERROR: Unable to allocate batch memory!\n");
+    return batch;
+}
+
+// Helper - forget the queued operations (the batch can be used again)
+static void clearBatch(sfs_batch* batch) {
+    for(int i = 0; i < batch->count; i++) {
+        free(batch->ops[i].path);
+        free(batch->ops[i].new_path);
+        free(batch->ops[i].data);
+    }
+    batch->count = 0;
+}
+
+// Free a batch and the operations still queued in it
+void sfs_batch_close(sfs_batch* batch) {
+    if(batch == NULL) return;
+    clearBatch(batch);
+    free(batch->ops);
+    free(batch);
+}
+
+// Helper - copy an operation to the end of the batch (copying its path, new path and data). Return 0, negative on error
+static int queueOp(sfs_batch* batch, int type, const char* path, const char* new_path, const char* data, int length,
+                   long offset) {
+    if(batch->count == batch->allocated) {
+        int allocated = (batch->allocated == 0) ? 16 : batch->allocated * 2;
+        BatchOp* ops = realloc(batch->ops, allocated * sizeof(BatchOp));
+        if(ops == NULL) {
+            fprintf(stderr, "ERROR: Unable to allocate batch memory!\n");
+            return -1;
+        }
+        batch->ops = ops;
+        batch->allocated = allocated;
+    }
+    BatchOp op = {.type = type, .path = strdup(path), .new_path = (new_path == NULL) ? NULL : strdup(new_path),
+                  .data = (length > 0) ? malloc(length) : NULL, .length = length, .offset = offset};
+    if(op.path == NULL || (new_path != NULL && op.new_path == NULL) || (length > 0 && op.data == NULL)) {
+        fprintf(stderr, "ERROR: Unable to allocate batch memory!\n");
+        free(op.path);
+        free(op.new_path);
+        free(op.data);
+        return -1;
+    }
+    if(length > 0) memcpy(op.data, data, length);
+    batch->ops[batch->count++] = op;
+    return 0;
+}
+
+// Queue the creation of an empty file at path from root. Return 0, negative on error
+int sfs_batch_create(sfs_batch* batch, const char* path) {
+    if(batch == NULL || path == NULL) return -1;
+    return queueOp(batch, BATCH_CREATE, path, NULL, NULL, 0, 0);
+}
+
+// Queue a write to the file at path from root (created if missing). Return 0, negative on error
+int sfs_batch_write(sfs_batch* batch, const char* path, const char* buf, int length, long offset) {
+    if(batch == NULL || path == NULL || length < 0 || (length > 0 && buf == NULL) || offset < 0) return -1;
+    return queueOp(batch, BATCH_WRITE, path, NULL, buf, length, offset);
+}
+
+// Queue the removal of the file or directory at path from root. Return 0, negative on error
+int sfs_batch_remove(sfs_batch* batch, const char* path) {
+    if(batch == NULL || path == NULL) return -1;
+    return queueOp(batch, BATCH_REMOVE, path, NULL, NULL, 0, 0);
+}
+
+// Queue a rename (or move) of old_path to new_path, both from root. Return 0, negative on error
+int sfs_batch_rename(sfs_batch* batch, const char* old_path, const char* new_path) {
+    if(batch == NULL || old_path == NULL || new_path == NULL) return -1;
+    return queueOp(batch, BATCH_RENAME, old_path, new_path, NULL, 0, 0);
+}
+
+
+// Helper - create the files of a run of create operations, those in one directory together. Results go in results
+static void runCreates(const BatchOp* ops, int count, int* results) {
+    char** paths = malloc(count * sizeof(char*));
+    int* fdt_indices = malloc(count * sizeof(int));
+    if(paths == NULL || fdt_indices == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate batch memory!\n");
+        for(int i = 0; i < count; i++) results[i] = -1;
+    } else {
+        for(int i = 0; i < count; i++) paths[i] = ops[i].path;
+        createPathFiles(paths, count, fdt_indices);
+        for(int i = 0; i < count; i++) {
+            results[i] = (fdt_indices[i] < 0) ? -1 : 0;
+            if(fdt_indices[i] >= 0) closeFDTNode(fdt_indices[i]);
+        }
+    }
+    free(paths);
+    free(fdt_indices);
+}
+
+// Helper - write the data of a write operation (as sfs_open_path then sfs_pwrite). Return bytes written
+static int runWrite(const BatchOp* op) {
+    int idx = fdtOpenFullPathFile(op->path);
+    if(idx < 0) {
+        idx = createPathFile(op->path, false);
+    } else if(fdtNode(idx)->is_directory) {
+        closeFDTNode(idx);
+        idx = -1;
+    }
+    if(idx < 0) return -1;
+
+    int bytes_written = -1;
+    if(op->offset <= fdtNode(idx)->size) {
+        bytes_written = (op->length < 1) ? 0 : overwriteDataAt(idx, op->data, op->length, op->offset);
+    }
+    closeFDTNode(idx);
+    return bytes_written;
+}
+
+// Run the queued operations in order, then empty the batch. Return number that succeeded, negative on error
+int sfs_batch_submit(sfs_batch* batch, int* results) {
+    if(batch == NULL) return -1;
+    int* own_results = NULL;
+    if(results == NULL) {
+        results = own_results = malloc((batch->count + 1) * sizeof(int));
+        if(own_results == NULL) {
+            fprintf(stderr, "ERROR: Unable to allocate batch memory!\n");
+            return -1;
+        }
+    }
+
+    pthread_rwlock_wrlock(&cur_fs->fs_lock);
+    holdSaves();
+    for(int i = 0; i < batch->count;) {
+        BatchOp* op = batch->ops + i;
+        if(op->type == BATCH_CREATE) {
+            int run = 1;
+            while(i + run < batch->count && batch->ops[i + run].type == BATCH_CREATE) run++;
+            runCreates(op, run, results + i);
+            i += run;
+            continue;
+        }
+        if(op->type == BATCH_WRITE) results[i] = runWrite(op);
+        else if(op->type == BATCH_REMOVE) results[i] = (removePathFile(op->path).inode_index < 0) ? -1 : 0;
+        else results[i] = renamePathFile(op->path, op->new_path) ? 0 : -1;
+        i++;
+    }
+    releaseSaves();
+    pthread_rwlock_unlock(&cur_fs->fs_lock);
+
+    int succeeded = 0;
+    for(int i = 0; i < batch->count; i++) {
+        if(results[i] >= 0) succeeded++;
+    }
+    clearBatch(batch);
+    free(own_results);
+    return succeeded;
+}
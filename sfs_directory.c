@@ -2,109 +2,951 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <limits.h>
 
 // NOTE: The root directory is called "root"
 #define DIRECTORY_SEPARATOR '\\'
 
-// NOTE: loadDirectory could fail on realloc. Properly catching everywhere this could happen
+// NOTE: Directory updates could fail part way on a full disk. Properly catching everywhere this could happen
 // is not simple, and was not done here.
 
 // TODO: Stop cycles in move/copy, and check recursive works well
 
 
+// A directory file is [DirectoryHeader, record1, record2, ...], each record an EntryRecord followed by the name.
+// Names are found through a separate index file: a B+tree keyed by (name hash, record offset), one node per block.
+// A lookup reads the blocks on one root to leaf path plus the record itself, so the directory is never loaded whole.
+
+typedef struct IndexKey {
+    unsigned int hash; // Hash of the entry name
+    int offset;        // Byte offset of the entry record in the directory file
+} IndexKey;
+
+typedef struct IndexChild {
+    IndexKey key;      // Smallest key under the child (ignored for the first child of a node)
+    int block;         // Index block of the child node
+} IndexChild;
+
+// Start of every index block, followed by IndexKeys (leaf) or IndexChilds (inner node)
+typedef struct IndexNode {
+    int level;         // 0 for leaves, height above the leaves otherwise
+    int count;         // Number of keys (leaf) or children (inner node)
+    int next;          // Next leaf in key order (-1 if last, unused for inner nodes)
+} IndexNode;
+
+#define LEAF_CAPACITY ((int) ((super_block.block_size - sizeof(IndexNode)) / sizeof(IndexKey)))
+#define INNER_CAPACITY ((int) ((super_block.block_size - sizeof(IndexNode)) / sizeof(IndexChild)))
+
+
+// Dentry cache of recently resolved (parent iNode, name) -> iNode, so repeated path lookups stay in memory.
+// Fixed size and set associative, the least recently used way of a set gets replaced
+#define DENTRY_SETS 128
+#define DENTRY_WAYS 4
+
+typedef struct DentryCacheEntry {
+    int parent_inode;        // iNode of the directory holding the name (-1 if unused)
+    int inode_index;         // iNode the name refers to
+    unsigned int last_used;  // Value of dentry_clock at last use
+    char name[MAXFILENAME + 1];
+} DentryCacheEntry;
+
+// Directory cache of loaded directories by iNode (header & open handles), so the current directories of every
+// session and path operations share loaded directories. Fixed size, the least recently used directory is replaced
+#define DIRECTORY_CACHE_SIZE 16
+
+// The caches of one file system, used through the names below (those of the calling thread's file system)
+struct DirectoryCaches {
+    DentryCacheEntry dentry_cache[DENTRY_SETS][DENTRY_WAYS];
+    unsigned int dentry_clock;
+
+    Directory directory_cache[DIRECTORY_CACHE_SIZE];
+    unsigned int directory_clock;
+
+    unsigned int directory_changes; // Bumped on every write to a directory file, so listing windows know to read again
+
+    // Held while using the dentry cache or the directory cache's LRU bookkeeping. Lookups and listings only hold
+    // fs_lock shared, so several of them can be at these at once (directories are only loaded with fs_lock exclusive)
+    pthread_mutex_t cache_lock;
+
+    // iNodes of the directories sessions have as their current directory (once per session), these can't be removed
+    int* pinned_dirs;
+    int pinned_count;
+    int pinned_allocated;
+};
+
+DirectoryCaches* newDirectoryCaches() {
+    DirectoryCaches* caches = calloc(1, sizeof(DirectoryCaches));
+    if(caches == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate directory cache memory!\n");
+        return NULL;
+    }
+    for(int i = 0; i < DENTRY_SETS; i++) {
+        for(int j = 0; j < DENTRY_WAYS; j++) caches->dentry_cache[i][j].parent_inode = -1;
+    }
+    for(int i = 0; i < DIRECTORY_CACHE_SIZE; i++) caches->directory_cache[i].inode_index = -1;
+    pthread_mutex_init(&caches->cache_lock, NULL);
+    return caches;
+}
+
+void freeDirectoryCaches(DirectoryCaches* caches) {
+    if(caches == NULL) return;
+    pthread_mutex_destroy(&caches->cache_lock);
+    free(caches->pinned_dirs);
+    free(caches);
+}
+
+#define dentry_cache (cur_fs->directory_caches->dentry_cache)
+#define dentry_clock (cur_fs->directory_caches->dentry_clock)
+#define directory_cache (cur_fs->directory_caches->directory_cache)
+#define directory_clock (cur_fs->directory_caches->directory_clock)
+#define directory_changes (cur_fs->directory_caches->directory_changes)
+#define cache_lock (cur_fs->directory_caches->cache_lock)
+#define pinned_dirs (cur_fs->directory_caches->pinned_dirs)
+#define pinned_count (cur_fs->directory_caches->pinned_count)
+#define pinned_allocated (cur_fs->directory_caches->pinned_allocated)
+
+
 // Helper for debugging, lists the files in current directory
 // static void printDirectoryTable() {
-//     for(int i = 0; i < cur_directory.file_number; i++) {
-//         fprintf(stderr, "NAME: %s \t\t\t\t INODE INDEX: %d \n", cur_directory.file_inode_map[i].name, cur_directory.file_inode_map[i].inode_index);
+//     DirectoryTableEntry entry;
+//     DirectoryWindow* window = NULL;
+//     for(int i = nextDirectoryEntry(dir_inode, 0, &entry, &window); i >= 0; i = nextDirectoryEntry(dir_inode, i, &entry, &window)) {
+//         fprintf(stderr, "NAME: %s \t\t\t\t INODE INDEX: %d \n", entry.name, entry.inode_index);
 //     }
+//     freeDirectoryWindow(window);
 // }
 
-// Private method to get index within directory table of given file name
-static int getDirectoryIndex(const char* fileName) {
-    DirectoryTableEntry cur_file;
-    for (int i = 0; i < cur_directory.file_number; i++) {
-        cur_file = cur_directory.file_inode_map[i];
-        if (strcmp(fileName, cur_file.name) == 0) return i;
+// Helper - hash of a file name (FNV-1a)
+static unsigned int hashName(const char* name) {
+    unsigned int hash = 2166136261u;
+    for(; *name != '\0'; name++) {
+        hash = (hash ^ (unsigned char) *name) * 16777619u;
+    }
+    return hash;
+}
+
+// Helper - dentry cache set holding (parent, name)
+static DentryCacheEntry* dentrySet(int parent_inode, const char* name) {
+    return dentry_cache[(hashName(name) ^ ((unsigned int) parent_inode * 2654435761u)) % DENTRY_SETS];
+}
+
+// Helper - cached iNode of name in the directory parent_inode, or -1 if not cached
+static int dentryLookup(int parent_inode, const char* name) {
+    DentryCacheEntry* set = dentrySet(parent_inode, name);
+    int inode_index = -1;
+    pthread_mutex_lock(&cache_lock);
+    for(int i = 0; i < DENTRY_WAYS; i++) {
+        if(set[i].parent_inode == parent_inode && strcmp(set[i].name, name) == 0) {
+            set[i].last_used = ++dentry_clock;
+            inode_index = set[i].inode_index;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return inode_index;
+}
+
+// Helper - remember that name in the directory parent_inode refers to inode_index
+static void dentryInsert(int parent_inode, const char* name, int inode_index) {
+    DentryCacheEntry* set = dentrySet(parent_inode, name);
+    DentryCacheEntry* victim = set;
+    pthread_mutex_lock(&cache_lock);
+    for(int i = 0; i < DENTRY_WAYS; i++) {
+        if(set[i].parent_inode == parent_inode && strcmp(set[i].name, name) == 0) {
+            victim = set + i;
+            break;
+        }
+        if(set[i].parent_inode < 0) {
+            if(victim->parent_inode >= 0) victim = set + i;
+        } else if(victim->parent_inode >= 0 && set[i].last_used < victim->last_used) {
+            victim = set + i;
+        }
+    }
+    victim->parent_inode = parent_inode;
+    victim->inode_index = inode_index;
+    victim->last_used = ++dentry_clock;
+    strcpy(victim->name, name);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// Helper - forget name in the directory parent_inode
+static void dentryRemove(int parent_inode, const char* name) {
+    DentryCacheEntry* set = dentrySet(parent_inode, name);
+    pthread_mutex_lock(&cache_lock);
+    for(int i = 0; i < DENTRY_WAYS; i++) {
+        if(set[i].parent_inode == parent_inode && strcmp(set[i].name, name) == 0) set[i].parent_inode = -1;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// Helper - forget every name in the directory parent_inode (it is being deleted, its iNode may be reused)
+static void dentryRemoveDirectory(int parent_inode) {
+    pthread_mutex_lock(&cache_lock);
+    for(int i = 0; i < DENTRY_SETS; i++) {
+        for(int j = 0; j < DENTRY_WAYS; j++) {
+            if(dentry_cache[i][j].parent_inode == parent_inode) dentry_cache[i][j].parent_inode = -1;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// Helper - order of index keys (by hash, then offset)
+static int compareKeys(IndexKey a, IndexKey b) {
+    if(a.hash != b.hash) return (a.hash < b.hash) ? -1 : 1;
+    return (a.offset > b.offset) - (a.offset < b.offset);
+}
+
+static IndexKey* leafKeys(IndexNode* node) {
+    return (IndexKey*) (node + 1);
+}
+
+static IndexChild* innerChildren(IndexNode* node) {
+    return (IndexChild*) (node + 1);
+}
+
+// Helper - bytes of the record for a name of the given length (rounded up to RECORD_ALIGN)
+static int recordLength(size_t name_length) {
+    return (int) ((sizeof(EntryRecord) + name_length + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN);
+}
+
+// Helper - free record list of dir holding records of the given length
+static int freeList(int record_length) {
+    return record_length / RECORD_ALIGN - 1;
+}
+
+// Helper - parse the record at the start of buffer (size bytes) into entry (name "" if free)
+// Returns the record length, or 0 if there is no whole record there
+static int parseRecord(const char* buffer, long size, DirectoryTableEntry* entry) {
+    if(size < (long) sizeof(EntryRecord)) return 0;
+    EntryRecord record;
+    memcpy(&record, buffer, sizeof(EntryRecord));
+    if(record.record_length < recordLength(record.name_length) || record.record_length > size) return 0;
+    entry->inode_index = record.inode_index;
+    entry->type = record.type;
+    memcpy(entry->name, buffer + sizeof(EntryRecord), record.name_length);
+    entry->name[record.name_length] = '\0';
+    return record.record_length;
+}
+
+// Helper - read the record at offset (before end) of the directory file at fdt_index into entry (name "" if free)
+// Returns the record length, or 0 if there is no record there
+static int readRecord(int fdt_index, long offset, long end, DirectoryTableEntry* entry) {
+    char buffer[MAX_RECORD_LENGTH];
+    long size = end - offset;
+    if(offset < (long) sizeof(DirectoryHeader) || size < (long) sizeof(EntryRecord)) return 0;
+    if(size > (long) MAX_RECORD_LENGTH) size = MAX_RECORD_LENGTH;
+    if(readDataAt(fdt_index, buffer, size, offset) != size) return 0; // One read, the name is usually in the same block
+    return parseRecord(buffer, size, entry);
+}
+
+// Helper - read the record (live or free) at offset of dir. Returns its length, or 0 if there is no record there
+static int readEntry(Directory* dir, long offset, DirectoryTableEntry* entry) {
+    return readRecord(dir->fdt_index, offset, dir->header.entries_end, entry);
+}
+
+// Helper - write to a directory or name index file (every directory layer write goes through here). While a batch
+// holds saves back, what it holds is written first, so a directory on disk never refers to an iNode or block that
+// isn't allocated on disk yet. The write isn't kept in a tail buffer either, directory blocks reach disk in order
+static long writeDirectoryData(int fdt_index, const void* data, long size, long offset) {
+    flushSaves();
+    directory_changes++;
+    long written = overwriteDataAt(fdt_index, data, size, offset);
+    flushFDTNode(fdt_index);
+    return written;
+}
+
+// Helper - put entry into buffer as a record of record_length bytes (padding zeroed)
+static void fillRecord(char* buffer, const DirectoryTableEntry* entry, int record_length) {
+    EntryRecord record = {.inode_index = entry->inode_index, 
+                          .record_length = (unsigned short) record_length, 
+                          .type = entry->type, 
+                          .name_length = (unsigned char) strlen(entry->name)};
+    memcpy(buffer, &record, sizeof(EntryRecord));
+    memcpy(buffer + sizeof(EntryRecord), entry->name, record.name_length);
+    memset(buffer + sizeof(EntryRecord) + record.name_length, 0, record_length - sizeof(EntryRecord) - record.name_length);
+}
+
+// Helper - write entry as a record of record_length bytes at offset of dir. Returns success
+static bool writeRecord(Directory* dir, long offset, const DirectoryTableEntry* entry, int record_length) {
+    char buffer[MAX_RECORD_LENGTH];
+    fillRecord(buffer, entry, record_length);
+    return writeDirectoryData(dir->fdt_index, buffer, record_length, offset) == record_length;
+}
+
+// Helper - mark the record at offset of dir free (one small in-place write) and push it on the list for its length
+static void freeRecord(Directory* dir, int offset, int record_length) {
+    int list = freeList(record_length);
+    EntryRecord record = {.inode_index = dir->header.free_records[list], 
+                          .record_length = (unsigned short) record_length, 
+                          .type = ENTRY_FREE, 
+                          .name_length = 0};
+    writeDirectoryData(dir->fdt_index, &record, sizeof(EntryRecord), offset);
+    dir->header.free_records[list] = offset;
+    dir->header.free_bytes += record_length;
+}
+
+// Helper - pop a free record of dir with room for record_length bytes (at most twice that, smallest first)
+// Returns its offset and sets record_length to its length, or returns -1 if there is none
+static int takeFreeRecord(Directory* dir, int* record_length) {
+    for(int length = *record_length; length <= 2 * *record_length && length <= (int) MAX_RECORD_LENGTH; length += RECORD_ALIGN) {
+        int list = freeList(length);
+        DirectoryTableEntry free_entry;
+        int offset = dir->header.free_records[list];
+        if(offset < 0 || readEntry(dir, offset, &free_entry) != length) continue;
+        dir->header.free_records[list] = free_entry.inode_index;
+        dir->header.free_bytes -= length;
+        *record_length = length;
+        return offset;
     }
     return -1;
 }
 
-// TODO: How to communicate to moveDirectoryFile if it's a subdirectory?
+// Helper - write the cached header of dir back to disk
+static void saveDirectoryHeader(Directory* dir) {
+    writeDirectoryData(dir->fdt_index, &dir->header, sizeof(DirectoryHeader), 0);
+}
 
-// Method to convert a pathname into an fdt index that can be manipulated. Pathname should be from root.
-// ex. "root//two//hello//abc.txt" should be passed "two//hello//abc.txt" 
-// Note: it is up to the programmer to close this fdt entry after use
-int fdtOpenFullPathFile(const char* pathName) {
-    int cur_dir_inode = fdt.table[cur_directory.fdt_index].inode_idx;
-    //bool is_cur_subdir = false;
-    loadDirectory(super_block.root_directory, true);
-    char* hold_buffer = malloc(MAXFILENAME + 1); // allow null character end
-    int i, j;
-    for(i=0, j=0; i <= strlen(pathName); i++, j++) {
-        // Should be impossible
-        if (j > MAXFILENAME) {
-            free(hold_buffer);
-            loadDirectory(cur_dir_inode, true);
-            return -1;
+// Helper - drop anything past entries_end from the end of the directory file
+static void truncateEntries(Directory* dir) {
+    long end = dir->header.entries_end;
+    long size = fdtNode(dir->fdt_index)->size;
+    if(size <= end) return;
+    fdt.table[dir->fdt_index].writePointer = size;
+    deleteData(dir->fdt_index, size - end);
+}
 
-        // load in the new subdirectory we were reading in hold_buffer
-        } else if(pathName[i] == DIRECTORY_SEPARATOR) {
-            hold_buffer[j] = '\0';
-            int dir_index = getDirectoryIndex(hold_buffer);
-            if (dir_index < 0) {
-                free(hold_buffer);
-                loadDirectory(cur_dir_inode, true);
-                return -1;
-            }
-            int inode_index = cur_directory.file_inode_map[dir_index].inode_index;
-            //if(inode_index == cur_dir_inode) is_cur_subdir = true;
-            if(!loadDirectory(inode_index, true)) {
-                free(hold_buffer);
-                loadDirectory(cur_dir_inode, true);
-                return -1;
-            }
-            j = -1; // for loop will increment
+static void readIndexBlock(Directory* dir, int block, IndexNode* node) {
+    readDataAt(dir->index_fdt, node, super_block.block_size, (long) block * super_block.block_size);
+}
 
-        // Update with newest character
-        } else {
-            hold_buffer[j] = pathName[i];
+static void writeIndexBlock(Directory* dir, int block, IndexNode* node) {
+    writeDirectoryData(dir->index_fdt, node, super_block.block_size, (long) block * super_block.block_size);
+}
+
+// Helper - add a block to the end of the index file. Returns its block number, or -1 if the disk is full
+static int newIndexBlock(Directory* dir, IndexNode* node) {
+    int block = dir->header.index_blocks;
+    long offset = (long) block * super_block.block_size;
+    if(writeDirectoryData(dir->index_fdt, node, super_block.block_size, offset) != super_block.block_size) return -1;
+    dir->header.index_blocks++;
+    return block;
+}
+
+// Helper - position of the child of an inner node whose subtree holds key (binary search)
+static int childPosition(IndexNode* node, IndexKey key) {
+    IndexChild* children = innerChildren(node);
+    int low = 1, high = node->count;
+    while(low < high) {
+        int mid = (low + high) / 2;
+        if(compareKeys(children[mid].key, key) <= 0) low = mid + 1;
+        else high = mid;
+    }
+    return low - 1;
+}
+
+// Helper - position of the first key in a leaf not less than key (binary search)
+static int leafPosition(IndexNode* node, IndexKey key) {
+    IndexKey* keys = leafKeys(node);
+    int low = 0, high = node->count;
+    while(low < high) {
+        int mid = (low + high) / 2;
+        if(compareKeys(keys[mid], key) < 0) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+// Helper - read the leaf that key belongs in into node. Returns its block number
+static int findLeaf(Directory* dir, IndexKey key, IndexNode* node) {
+    int block = dir->header.index_root;
+    readIndexBlock(dir, block, node);
+    while(node->level > 0) {
+        block = innerChildren(node)[childPosition(node, key)].block;
+        readIndexBlock(dir, block, node);
+    }
+    return block;
+}
+
+// Helper - put an item (key or child of item_size bytes) at pos of the node read from block, splitting the node
+// in two if it is full. Returns 1 on split (split describes the new right half), 0 if not, -1 on error
+static int insertIntoNode(Directory* dir, int block, IndexNode* node, int pos, const void* item, int item_size, 
+                          int capacity, IndexChild* split) {
+    char* items = (char*) (node + 1);
+    if(node->count < capacity) {
+        memmove(items + (pos + 1) * item_size, items + pos * item_size, (node->count - pos) * item_size);
+        memcpy(items + pos * item_size, item, item_size);
+        node->count++;
+        writeIndexBlock(dir, block, node);
+        return 0;
+    }
+
+    // Full: line up all the items, keep the lower half here and move the upper half to a new block
+    char* all = malloc((capacity + 1) * item_size);
+    memcpy(all, items, pos * item_size);
+    memcpy(all + pos * item_size, item, item_size);
+    memcpy(all + (pos + 1) * item_size, items + pos * item_size, (capacity - pos) * item_size);
+    int left_count = (capacity + 1) / 2;
+
+    IndexNode* right = calloc(1, super_block.block_size);
+    right->level = node->level;
+    right->count = capacity + 1 - left_count;
+    right->next = node->next;
+    memcpy(right + 1, all + left_count * item_size, right->count * item_size);
+    int right_block = newIndexBlock(dir, right);
+    if(right_block >= 0) {
+        node->count = left_count;
+        if(node->level == 0) node->next = right_block;
+        memcpy(items, all, left_count * item_size);
+        writeIndexBlock(dir, block, node);
+
+        // The first key of the right half separates the two
+        split->key = (node->level == 0) ? leafKeys(right)[0] : innerChildren(right)[0].key;
+        split->block = right_block;
+    }
+    free(right);
+    free(all);
+    return (right_block >= 0) ? 1 : -1;
+}
+
+// Helper - insert key under the index node at block. Returns 1 on split (split describes the new right half), 0 if not, -1 on error
+static int insertIntoSubtree(Directory* dir, int block, IndexKey key, IndexChild* split) {
+    IndexNode* node = malloc(super_block.block_size);
+    readIndexBlock(dir, block, node);
+    int result;
+    if(node->level == 0) {
+        result = insertIntoNode(dir, block, node, leafPosition(node, key), &key, sizeof(IndexKey), LEAF_CAPACITY, split);
+    } else {
+        int pos = childPosition(node, key);
+        IndexChild child_split;
+        result = insertIntoSubtree(dir, innerChildren(node)[pos].block, key, &child_split);
+        if(result == 1) {
+            result = insertIntoNode(dir, block, node, pos + 1, &child_split, sizeof(IndexChild), INNER_CAPACITY, split);
+        }
+    }
+    free(node);
+    return result;
+}
+
+// Helper - add key to the name index of dir (header saved by caller). Returns success
+static bool indexInsert(Directory* dir, IndexKey key) {
+    IndexChild split;
+    int result = insertIntoSubtree(dir, dir->header.index_root, key, &split);
+    if(result == 1) {
+        // Root split, the tree grows a level
+        IndexNode* root = calloc(1, super_block.block_size);
+        readIndexBlock(dir, dir->header.index_root, root);
+        int level = root->level + 1;
+        memset(root, 0, super_block.block_size);
+        root->level = level;
+        root->count = 2;
+        root->next = -1;
+        innerChildren(root)[0] = (IndexChild) {.key = {0, 0}, .block = dir->header.index_root};
+        innerChildren(root)[1] = split;
+        int root_block = newIndexBlock(dir, root);
+        if(root_block >= 0) dir->header.index_root = root_block;
+        else result = -1;
+        free(root);
+    }
+    return result >= 0;
+}
+
+// Helper - remove key from the name index of dir. Nodes are never merged, so an emptied leaf stays in the chain
+// (lookups step over it) until the directory is deleted. Returns whether the key was found
+static bool indexRemove(Directory* dir, IndexKey key) {
+    IndexNode* node = malloc(super_block.block_size);
+    int block = findLeaf(dir, key, node);
+    int pos = leafPosition(node, key);
+    bool found = pos < node->count && compareKeys(leafKeys(node)[pos], key) == 0;
+    if(found) {
+        memmove(leafKeys(node) + pos, leafKeys(node) + pos + 1, (node->count - pos - 1) * sizeof(IndexKey));
+        node->count--;
+        writeIndexBlock(dir, block, node);
+    }
+    free(node);
+    return found;
+}
+
+// Helper - find the entry named fileName in dir. Returns its offset (and fills entry if not NULL), or -1 if missing
+static int findEntry(Directory* dir, const char* fileName, DirectoryTableEntry* entry) {
+    IndexKey key = {.hash = hashName(fileName), .offset = INT_MIN};
+    IndexNode* node = malloc(super_block.block_size);
+    findLeaf(dir, key, node);
+
+    // Entries with a matching hash are consecutive from here, possibly running into later leaves
+    DirectoryTableEntry found;
+    int offset = -1;
+    int pos = leafPosition(node, key);
+    while(offset < 0) {
+        if(pos == node->count) {
+            if(node->next < 0) break;
+            readIndexBlock(dir, node->next, node);
+            pos = 0;
+            continue;
+        }
+        IndexKey cur = leafKeys(node)[pos++];
+        if(cur.hash != key.hash) break;
+        if(readEntry(dir, cur.offset, &found) > 0 && strcmp(found.name, fileName) == 0) offset = cur.offset;
+    }
+    free(node);
+    if(offset >= 0 && entry != NULL) *entry = found;
+    return offset;
+}
+
+// Helper - add n entries to dir and index them. Free records are filled first, the rest are appended with one write
+// Returns success (nothing is added on failure)
+static bool addEntries(Directory* dir, const DirectoryTableEntry* entries, int n) {
+    int* offsets = malloc(n * sizeof(int));
+    int* lengths = malloc(n * sizeof(int));
+    if(offsets == NULL || lengths == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate directory entry memory!\n");
+        free(offsets);
+        free(lengths);
+        return false;
+    }
+
+    // Place every record, in a free record if one fits or else after the last record
+    int end = dir->header.entries_end;
+    long append_size = 0;
+    for(int i = 0; i < n; i++) {
+        lengths[i] = recordLength(strlen(entries[i].name));
+        offsets[i] = takeFreeRecord(dir, lengths + i);
+        if(offsets[i] < 0) {
+            offsets[i] = end + append_size;
+            append_size += lengths[i];
+        }
+    }
+    char* appended = malloc(append_size + 1);
+    bool success = appended != NULL;
+    for(int i = 0; success && i < n; i++) {
+        if(offsets[i] < end) success = writeRecord(dir, offsets[i], entries + i, lengths[i]);
+        else fillRecord(appended + (offsets[i] - end), entries + i, lengths[i]);
+    }
+    success = success && (append_size == 0 || writeDirectoryData(dir->fdt_index, appended, append_size, end) == append_size);
+    free(appended);
+
+    int indexed = 0;
+    while(success && indexed < n) {
+        success = indexInsert(dir, (IndexKey) {.hash = hashName(entries[indexed].name), .offset = offsets[indexed]});
+        if(success) indexed++;
+    }
+    if(!success) {
+        for(int i = 0; i < indexed; i++) {
+            indexRemove(dir, (IndexKey) {.hash = hashName(entries[i].name), .offset = offsets[i]});
+        }
+        // Give the reused records back, in reverse so every free list is as it was
+        for(int i = n - 1; i >= 0; i--) {
+            if(offsets[i] < end) freeRecord(dir, offsets[i], lengths[i]);
+        }
+        truncateEntries(dir);
+        saveDirectoryHeader(dir); // Index may have grown before failing
+    } else {
+        dir->header.entries_end += append_size;
+        dir->header.file_number += n;
+        saveDirectoryHeader(dir);
+        for(int i = 0; i < n; i++) {
+            dentryInsert(fdt.table[dir->fdt_index].inode_idx, entries[i].name, entries[i].inode_index);
         }
     }
-    // We now have the correct directory loaded and can retrieve the name in hold_buffer
-    int fdt_idx = openDirectoryFile(hold_buffer);
-    free(hold_buffer);
+    free(offsets);
+    free(lengths);
+    return success;
+}
 
-    // Restore condition. In future could make this go on a boolean flag
-    loadDirectory(cur_dir_inode, true);
+// Helper - add an entry to dir (into a free record if one fits) and index it. Returns success
+static bool addEntry(Directory* dir, DirectoryTableEntry entry) {
+    return addEntries(dir, &entry, 1);
+}
+
+// Helper - slide the live records of dir down over the free ones (dropping any padding past their names),
+// then cut the file after the last one. The records are read, packed in memory and written back in one go each
+static void compactEntries(Directory* dir) {
+    long size = dir->header.entries_end - sizeof(DirectoryHeader);
+    char* records = malloc(size + 1);
+    if(records == NULL || readDataAt(dir->fdt_index, records, size, sizeof(DirectoryHeader)) != size) {
+        free(records); // Left as is, tried again on the next removal
+        return;
+    }
+
+    DirectoryTableEntry entry;
+    long write = 0;
+    long read = 0;
+    int record_length;
+    while((record_length = parseRecord(records + read, size - read, &entry)) > 0) {
+        if(entry.type != ENTRY_FREE) {
+            int packed = recordLength(strlen(entry.name));
+            fillRecord(records + write, &entry, packed); // entry is a copy, so overlapping the record read is fine
+            if(write != read) {
+                unsigned int hash = hashName(entry.name);
+                indexRemove(dir, (IndexKey) {.hash = hash, .offset = (int) (read + sizeof(DirectoryHeader))});
+                indexInsert(dir, (IndexKey) {.hash = hash, .offset = (int) (write + sizeof(DirectoryHeader))});
+            }
+            write += packed;
+        }
+        read += record_length;
+    }
+    if(write > 0) writeDirectoryData(dir->fdt_index, records, write, sizeof(DirectoryHeader));
+    free(records);
+    for(int i = 0; i < FREE_LISTS; i++) dir->header.free_records[i] = -1;
+    dir->header.free_bytes = 0;
+    dir->header.entries_end = write + sizeof(DirectoryHeader);
+    truncateEntries(dir);
+}
+
+// Helper - take the entry at offset (holding removed, record_length bytes) out of dir, leaving a free record there
+// The directory is compacted once most of its bytes are free records
+static void removeEntry(Directory* dir, int offset, int record_length, DirectoryTableEntry removed) {
+    dentryRemove(fdt.table[dir->fdt_index].inode_idx, removed.name);
+    indexRemove(dir, (IndexKey) {.hash = hashName(removed.name), .offset = offset});
+    freeRecord(dir, offset, record_length);
+    dir->header.file_number--;
+    long used = dir->header.entries_end - sizeof(DirectoryHeader);
+    if(4L * dir->header.free_bytes >= 3 * used) compactEntries(dir);
+    saveDirectoryHeader(dir);
+}
+
+// Helper - open the directory with the given iNode into dir (header read, handles opened). Returns success
+static bool openDirectory(int inode_index, Directory* dir) {
+    int fdt_index = openFDTNode(inode_index);
+    if(fdt_index < 0) return false;
+    if(!fdtNode(fdt_index)->is_directory) {
+        fprintf(stderr, "Attempting to load data file as a directory, load cancelled\n");
+        closeFDTNode(fdt_index);
+        return false;
+    }
+
+    DirectoryHeader header;
+    int index_fdt = -1;
+    if(readDataAt(fdt_index, &header, sizeof(DirectoryHeader), 0) == sizeof(DirectoryHeader)) {
+        index_fdt = openFDTNode(header.index_inode);
+    }
+    if(index_fdt < 0) {
+        fprintf(stderr, "ERROR (Load directory): Unable to open name index of directory (iNode %d)!\n", inode_index);
+        closeFDTNode(fdt_index);
+        return false;
+    }
+    *dir = (Directory) {.header = header, .fdt_index = fdt_index, .index_fdt = index_fdt, .inode_index = inode_index};
+    return true;
+}
 
-    return fdt_idx;
+// Helper - close the handles of a directory opened with openDirectory
+static void closeDirectory(Directory* dir) {
+    closeFDTNode(dir->fdt_index);
+    closeFDTNode(dir->index_fdt);
+    dir->inode_index = -1;
 }
 
-// Opens the file with the given name (in the current directory) in our FDT and returns the fdt index
-int openDirectoryFile(const char* fileName) {
-    // Find inode # of file with fileName using cur_directory
-    //int dir_idx = getDirectoryIndex
-    int inode_idx = -1;
-    DirectoryTableEntry cur_file;
-    for (int i = 0; i < cur_directory.file_number; i++) {
-        cur_file = cur_directory.file_inode_map[i];
-        if (strcmp(fileName, cur_file.name) == 0) {
-            inode_idx = cur_file.inode_index;
+// Helper - the directory with the given iNode if it is in the directory cache, NULL if not. Never opens anything,
+// so it is safe with fs_lock shared (nothing is replaced in the cache until fs_lock is held exclusive)
+static Directory* cachedDirectory(int inode_index) {
+    Directory* found = NULL;
+    pthread_mutex_lock(&cache_lock);
+    for(int i = 0; i < DIRECTORY_CACHE_SIZE; i++) {
+        if(directory_cache[i].inode_index == inode_index) {
+            found = directory_cache + i;
+            found->last_used = ++directory_clock;
             break;
         }
     }
+    pthread_mutex_unlock(&cache_lock);
+    return found;
+}
+
+// Whether the directory with iNode dir_inode is in the directory cache (listing it then only needs fs_lock shared)
+bool directoryCached(int dir_inode) {
+    return cachedDirectory(dir_inode) != NULL;
+}
+
+// Helper - the cached directory with the given iNode, opening it (in place of the least recently used directory)
+// if needed. Returns NULL if it can't be opened. Only valid until the next call, which may replace it
+static Directory* getDirectory(int inode_index) {
+    Directory* cached = cachedDirectory(inode_index);
+    if(cached != NULL) return cached;
+
+    Directory* victim = NULL;
+    for(int i = 0; i < DIRECTORY_CACHE_SIZE; i++) {
+        Directory* dir = directory_cache + i;
+        if(victim == NULL || (victim->inode_index >= 0 && (dir->inode_index < 0 || dir->last_used < victim->last_used))) {
+            victim = dir;
+        }
+    }
+
+    Directory loaded;
+    if(!openDirectory(inode_index, &loaded)) return NULL;
+    if(victim->inode_index >= 0) closeDirectory(victim);
+    *victim = loaded;
+    victim->last_used = ++directory_clock;
+    return victim;
+}
+
+// Helper - take the directory with the given iNode out of the cache (it is being deleted)
+static void dropDirectory(int inode_index) {
+    for(int i = 0; i < DIRECTORY_CACHE_SIZE; i++) {
+        if(directory_cache[i].inode_index == inode_index) closeDirectory(directory_cache + i);
+    }
+}
+
+// Empty the directory and dentry caches (new or reloaded file system, no handles are closed)
+void resetDirectoryCaches() {
+    for(int i = 0; i < DENTRY_SETS; i++) {
+        for(int j = 0; j < DENTRY_WAYS; j++) dentry_cache[i][j].parent_inode = -1;
+    }
+    dentry_clock = 0;
+    for(int i = 0; i < DIRECTORY_CACHE_SIZE; i++) directory_cache[i].inode_index = -1;
+    directory_clock = 0;
+    directory_changes++; // Windows read from the old file system are stale
+    pinned_count = 0;
+}
+
+// Helper - write an empty directory (header and name index) into the new directory iNode at fdt_index. Returns success
+static bool initDirectory(int fdt_index, int parent_inode_index) {
+    int index_fdt = createINode(false);
+    if(index_fdt < 0) return false;
+
+    IndexNode* leaf = calloc(1, super_block.block_size);
+    leaf->next = -1;
+    DirectoryHeader header = {.parent_inode_index = parent_inode_index, 
+                              .file_number = 0, 
+                              .entries_end = sizeof(DirectoryHeader), 
+                              .free_bytes = 0, 
+                              .index_inode = fdt.table[index_fdt].inode_idx, 
+                              .index_root = 0, 
+                              .index_blocks = 1};
+    for(int i = 0; i < FREE_LISTS; i++) header.free_records[i] = -1;
+    bool success = overwriteData(index_fdt, leaf, super_block.block_size) == super_block.block_size
+                   && writeDirectoryData(fdt_index, &header, sizeof(DirectoryHeader), 0) == sizeof(DirectoryHeader);
+    free(leaf);
+    if(success) closeFDTNode(index_fdt);
+    else deleteINode(index_fdt);
+    return success;
+}
+
+// Helper - append value to the growing array list (count used of allocated). Returns success
+static bool pushInt(int** list, int* count, int* allocated, int value) {
+    if(*count == *allocated) {
+        int new_allocated = (*allocated == 0) ? 64 : *allocated * 2;
+        int* new_list = realloc(*list, new_allocated * sizeof(int));
+        if(new_list == NULL) {
+            fprintf(stderr, "ERROR: Unable to allocate directory tree memory!\n");
+            return false;
+        }
+        *list = new_list;
+        *allocated = new_allocated;
+    }
+    (*list)[(*count)++] = value;
+    return true;
+}
+
+// Helper - take a link off the file with the given iNode (one of its entries is going away)
+// Returns whether that was its last link, so the file goes too
+static bool dropLink(int inode_index) {
+    int fdt_index = openFDTNode(inode_index);
+    if(fdt_index < 0) return true;
+    bool last = fdtNode(fdt_index)->link_count <= 1;
+    if(!last) {
+        fdtNode(fdt_index)->link_count--;
+        saveFDTNode(fdt_index);
+    }
+    closeFDTNode(fdt_index);
+    return last;
+}
+
+// Helper - add the name index and every entry of the directory with the given iNode to doomed (files only if
+// this was their last link), and its subdirectories to the directory queue too. The directory is read whole in
+// one go. Returns success
+static bool collectDirectory(int inode_index, int** doomed, int* doomed_count, int* doomed_allocated,
+                             int** queue, int* queue_count, int* queue_allocated) {
+    dropDirectory(inode_index);
+    dentryRemoveDirectory(inode_index);
+    int fdt_index = openFDTNode(inode_index);
+    if(fdt_index < 0) return false;
+
+    DirectoryHeader header;
+    char* records = NULL;
+    long size = 0;
+    bool success = readDataAt(fdt_index, &header, sizeof(DirectoryHeader), 0) == sizeof(DirectoryHeader);
+    if(success) {
+        size = header.entries_end - sizeof(DirectoryHeader);
+        records = malloc(size + 1);
+        success = records != NULL && readDataAt(fdt_index, records, size, sizeof(DirectoryHeader)) == size
+                  && pushInt(doomed, doomed_count, doomed_allocated, header.index_inode);
+    }
+    closeFDTNode(fdt_index);
+
+    DirectoryTableEntry entry;
+    int record_length;
+    for(long offset = 0; success && (record_length = parseRecord(records + offset, size - offset, &entry)) > 0;
+        offset += record_length) {
+        if(entry.type == ENTRY_FREE || (entry.type == ENTRY_FILE && !dropLink(entry.inode_index))) continue;
+        success = pushInt(doomed, doomed_count, doomed_allocated, entry.inode_index);
+        if(success && entry.type == ENTRY_DIRECTORY) success = pushInt(queue, queue_count, queue_allocated, entry.inode_index);
+    }
+    free(records);
+    return success;
+}
+
+// Helper - delete the iNode at fdt_index (closing the handle), and everything under it if it is a directory.
+// The tree is walked with a queue of directories (no recursion), and every iNode found is deleted at the end
+// together, with one bit map save. With orphan, they go on the orphan list instead (space freed later)
+static void deleteTree(int fdt_index, bool orphan) {
+    int inode_index = fdt.table[fdt_index].inode_idx;
+    if(!fdtNode(fdt_index)->is_directory && !orphan) {
+        deleteINode(fdt_index);
+        return;
+    }
+
+    int *doomed = NULL, *queue = NULL;
+    int doomed_count = 0, doomed_allocated = 0, queue_count = 0, queue_allocated = 0;
+    bool success = pushInt(&doomed, &doomed_count, &doomed_allocated, inode_index);
+    if(fdtNode(fdt_index)->is_directory) success = success && pushInt(&queue, &queue_count, &queue_allocated, inode_index);
+    for(int next = 0; success && next < queue_count; next++) {
+        success = collectDirectory(queue[next], &doomed, &doomed_count, &doomed_allocated, &queue, &queue_count, &queue_allocated);
+    }
+    free(queue);
+
+    // Out of memory part way: only what was found goes, the rest of the tree is left unreachable
+    // Either drops every handle on them, fdt_index too
+    if(orphan) orphanINodes(doomed, doomed_count);
+    else deleteINodes(doomed, doomed_count);
+    free(doomed);
+}
+
+// Helper - whether the directory with iNode dir_inode is the directory ancestor or somewhere under it
+static bool isWithin(int dir_inode, int ancestor) {
+    int cur = dir_inode;
+    while(cur >= 0) {
+        if(cur == ancestor) return true;
+        int fdt_index = openFDTNode(cur);
+        if(fdt_index < 0) break;
+        readDataAt(fdt_index, &cur, sizeof(cur), 0); // Parent is the first field of the header
+        closeFDTNode(fdt_index);
+    }
+    return false;
+}
+
+// Helper - whether the directory with the given iNode is a current directory (of any session) or one of its parents
+static bool holdsCurrentDirectory(int inode_index) {
+    for(int i = 0; i < pinned_count; i++) {
+        if(isWithin(pinned_dirs[i], inode_index)) return true;
+    }
+    return false;
+}
+
+// Mark the directory with the given iNode as a session's current directory (once per session using it)
+bool pinDirectory(int inode_index) {
+    return pushInt(&pinned_dirs, &pinned_count, &pinned_allocated, inode_index);
+}
+
+// Undo one pinDirectory of the directory with the given iNode
+void unpinDirectory(int inode_index) {
+    for(int i = 0; i < pinned_count; i++) {
+        if(pinned_dirs[i] == inode_index) {
+            pinned_dirs[i] = pinned_dirs[--pinned_count];
+            return;
+        }
+    }
+}
+
+// Helper - give the directory with the given iNode a new parent (first field of its header, and the cached header if loaded)
+static void setParentDirectory(int inode_index, int parent_inode_index) {
+    int fdt_index = openFDTNode(inode_index);
+    if(fdt_index < 0) return;
+    writeDirectoryData(fdt_index, &parent_inode_index, sizeof(parent_inode_index), 0);
+    closeFDTNode(fdt_index);
+    for(int i = 0; i < DIRECTORY_CACHE_SIZE; i++) {
+        if(directory_cache[i].inode_index == inode_index) directory_cache[i].header.parent_inode_index = parent_inode_index;
+    }
+}
+
+// Helper - iNode of name in the directory with iNode dir_inode, or -1 if missing. Uses the dentry cache, falling
+// back to the directory's index (without changing the current directory). With cached_only, a directory that isn't
+// in the directory cache isn't opened, PATH_NOT_CACHED is returned instead
+static int findInode(int dir_inode, const char* name, bool cached_only) {
+    int inode_index = dentryLookup(dir_inode, name);
+    if(inode_index >= 0) return inode_index;
+
+    DirectoryTableEntry entry;
+    Directory* dir = cached_only ? cachedDirectory(dir_inode) : getDirectory(dir_inode);
+    if(dir == NULL && cached_only) return PATH_NOT_CACHED;
+    if(dir == NULL || findEntry(dir, name, &entry) < 0) return -1;
+    dentryInsert(dir_inode, name, entry.inode_index);
+    return entry.inode_index;
+}
+
+static int lookupInode(int dir_inode, const char* name) {
+    return findInode(dir_inode, name, false);
+}
+
+// Helper - resolveParent, with cached_only as for findInode (PATH_NOT_CACHED if a directory on the way isn't cached)
+static int resolvePath(const char* pathName, char* name, bool cached_only) {
+    int inode_index = super_block.root_directory;
+    const char* start = pathName;
+    while(true) {
+        const char* end = strchr(start, DIRECTORY_SEPARATOR);
+        size_t length = (end == NULL) ? strlen(start) : (size_t) (end - start);
+        if(length > MAXFILENAME) return -1;
+        memcpy(name, start, length);
+        name[length] = '\0';
+        if(end == NULL) return inode_index;
+
+        inode_index = findInode(inode_index, name, cached_only);
+        if(inode_index < 0) return inode_index;
+        start = end + 1;
+    }
+}
+
+// Helper - resolve every component of pathName (from root) but the last, which is copied into name.
+// Returns the iNode of the directory holding the last component, or -1 if a component is missing or too long
+static int resolveParent(const char* pathName, char* name) {
+    return resolvePath(pathName, name, false);
+}
+
+// Helper - iNode of the file or directory at pathName from root, see findInode for cached_only
+static int pathINode(const char* pathName, bool cached_only) {
+    char name[MAXFILENAME + 1];
+    int parent_inode = resolvePath(pathName, name, cached_only);
+    if(parent_inode < 0) return parent_inode;
+    return findInode(parent_inode, name, cached_only);
+}
+
+// iNode of the file or directory at pathName from root, or -1 if missing. Directories are opened as needed
+int fullPathINode(const char* pathName) {
+    return pathINode(pathName, false);
+}
+
+// iNode of the file or directory at pathName from root, found only through the dentry & directory caches so it is
+// safe with fs_lock shared. Returns -1 if missing, PATH_NOT_CACHED if a directory on the way has to be opened first
+// (fullPathINode, with fs_lock exclusive)
+int cachedPathINode(const char* pathName) {
+    return pathINode(pathName, true);
+}
+
+// TODO: How to communicate to moveDirectoryFile if it's a subdirectory?
+
+// Method to convert a pathname into an fdt index that can be manipulated. Pathname should be from root.
+// ex. "root//two//hello//abc.txt" should be passed "two//hello//abc.txt" 
+// Components are resolved through the dentry and directory caches, the current directory is left alone
+// Note: it is up to the programmer to close this fdt entry after use
+int fdtOpenFullPathFile(const char* pathName) {
+    int inode_index = fullPathINode(pathName);
+    if(inode_index < 0) return -1;
+    return openFDTNode(inode_index);
+}
+
+// Opens the file with the given name (in the directory with iNode dir_inode) in our FDT and returns the fdt index
+int openDirectoryFile(int dir_inode, const char* fileName) {
+    // Find inode # of file with fileName using the directory (cached or through its index)
+    int inode_idx = lookupInode(dir_inode, fileName);
     if(inode_idx < 0) return -1;
     return openFDTNode(inode_idx);
 }
 
 
-// Adds a file with given name to the directory - returns file descriptor table index
-int createDirectoryFile(const char* name, bool is_directory) {
+// Helper - adds a file with given name to dir (NULL when creating the root) - returns file descriptor table index
+static int createFileIn(Directory* dir, const char* name, bool is_directory) {
+    if(dir != NULL && name[0] == '\0') return -1;
     // Create new iNode on disk and cache
     int fdt_index = createINode(is_directory);
     if (fdt_index < 0) return fdt_index;
-    fdt.inodes[fdt_index].link_count = 1;
-    int curDirIdx = cur_directory.fdt_index;
 
     // Space check
     if(fdt_index < 0) {
@@ -112,278 +954,538 @@ int createDirectoryFile(const char* name, bool is_directory) {
         return fdt_index;
     } 
 
-    // Pre-fill parent-index if creating directory iNode (may be useful if I extend directories) 
-    // curDirIdx<0 checks if a parent exists (we may be adding a root)
+    // Write an empty directory (header & name index) if creating directory iNode
+    // dir==NULL means no parent exists (we are adding a root)
     if (is_directory) { 
-        int* par_idx = malloc(sizeof(cur_directory.parent_inode_index));
-        if(curDirIdx < 0) *par_idx = -1;
-        else *par_idx = fdt.table[curDirIdx].inode_idx;
-        overwriteData(fdt_index, par_idx, sizeof(cur_directory.parent_inode_index));
-        free(par_idx);
-    }
-    if(curDirIdx < 0) return fdt_index;
-
-    // Adding the new entry to current directory data block
-    
-    // Allocate more cache memory as needed
-    if(cur_directory.file_number == cur_directory.table_size) {
-        cur_directory.table_size += 5;
-        DirectoryTableEntry* new_dir_mem = realloc(cur_directory.file_inode_map, cur_directory.table_size * sizeof(DirectoryTableEntry));
-        if(new_dir_mem == NULL) {
-            fprintf(stderr, "ERROR  (create file): Unable to allocate directory cache memory!\n");
+        int par_idx = (dir == NULL) ? -1 : dir->inode_index;
+        if(!initDirectory(fdt_index, par_idx)) {
+            deleteINode(fdt_index);
             return -1;
         }
-        cur_directory.file_inode_map = new_dir_mem;
     }
+    if(dir == NULL) return fdt_index;
 
-    // Fill cache directory table with data
-    cur_directory.file_inode_map[cur_directory.file_number].inode_index = fdt.table[fdt_index].inode_idx;
-    strcpy(cur_directory.file_inode_map[cur_directory.file_number].name, name);
-
-    // Write cache directory to disk (new entry)
-    overwriteData(curDirIdx, cur_directory.file_inode_map + cur_directory.file_number, sizeof(DirectoryTableEntry));
-    cur_directory.file_number++;
+    // Adding the new entry to the directory
+    DirectoryTableEntry entry = {.inode_index = fdt.table[fdt_index].inode_idx, 
+                                 .type = is_directory ? ENTRY_DIRECTORY : ENTRY_FILE};
+    strcpy(entry.name, name);
+    if(!addEntry(dir, entry)) {
+        deleteTree(fdt_index, false);
+        return -1;
+    }
     return fdt_index;
 }
 
+// Adds a file with given name to the directory with iNode dir_inode (-1 creates the root) - returns file descriptor table index
+int createDirectoryFile(int dir_inode, const char* name, bool is_directory) {
+    if(dir_inode < 0) return createFileIn(NULL, name, is_directory);
+    Directory* dir = getDirectory(dir_inode);
+    if(dir == NULL) return -1;
+    return createFileIn(dir, name, is_directory);
+}
 
-// Does the actual work of deleting data from directory. Hidden to hide details like stopping iNode deletion
-static DirectoryTableEntry _removeDirectoryFile(int directory_index, bool delete_data) {
+static int compareNames(const void* a, const void* b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
 
-    // Get info about node to remove
-    DirectoryTableEntry remove = cur_directory.file_inode_map[directory_index];
-    int fdt_index = openFDTNode(remove.inode_index);
-    iNode remove_inode = fdt.inodes[fdt_index];
+// Adds files with the given names to the directory with iNode dir_inode, creating their iNodes and entries together
+// Returns count with the fdt indices in fdt_indices, or -1 with nothing added (name empty, taken or repeated, or no space)
+int createDirectoryFiles(int dir_inode, char** names, int count, int* fdt_indices) {
+    char** sorted = malloc(count * sizeof(char*));
+    DirectoryTableEntry* entries = malloc(count * sizeof(DirectoryTableEntry));
+    if(sorted == NULL || entries == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate directory entry memory!\n");
+        free(sorted);
+        free(entries);
+        return -1;
+    }
 
-    // Delete the iNodes data if needed, recursive delete for subdirectories
-    if(delete_data) {
-        if(remove_inode.is_directory) {
-            loadDirectory(remove.inode_index, false); // Don't close going down
-            while(cur_directory.file_number > 0) {
-                // Removing last saves time
-                _removeDirectoryFile(cur_directory.file_number - 1, delete_data);
-            }
-            loadDirectory(cur_directory.parent_inode_index, false); // Leave open for deleteINode
-        }
+    // Check every name before creating anything
+    memcpy(sorted, names, count * sizeof(char*));
+    qsort(sorted, count, sizeof(char*), compareNames);
+    bool valid = true;
+    for(int i = 0; valid && i < count; i++) {
+        valid = sorted[i][0] != '\0' && strlen(sorted[i]) <= MAXFILENAME
+                && (i == 0 || strcmp(sorted[i - 1], sorted[i]) != 0)
+                && lookupInode(dir_inode, sorted[i]) < 0;
+    }
+    free(sorted);
+    Directory* dir = valid ? getDirectory(dir_inode) : NULL;
+    if(dir == NULL || createINodes(count, false, fdt_indices) < 0) {
+        free(entries);
+        return -1;
+    }
 
-        // Delete the file's iNode - closes the FDT entry too
-        deleteINode(fdt_index);
+    for(int i = 0; i < count; i++) {
+        entries[i] = (DirectoryTableEntry) {.inode_index = fdt.table[fdt_indices[i]].inode_idx, .type = ENTRY_FILE};
+        strcpy(entries[i].name, names[i]);
+    }
+    bool added = addEntries(dir, entries, count);
+    free(entries);
+    if(!added) {
+        for(int i = 0; i < count; i++) deleteINode(fdt_indices[i]);
+        return -1;
     }
+    return count;
+}
 
-    // Update current directory (data)
+// Adds a file at the given path (from root), its directory must exist - returns file descriptor table index
+int createPathFile(const char* pathName, bool is_directory) {
+    char name[MAXFILENAME + 1];
+    int parent_inode = resolveParent(pathName, name);
+    if(parent_inode < 0 || name[0] == '\0') return -1;
+    Directory* dir = getDirectory(parent_inode);
+    if(dir == NULL || findEntry(dir, name, NULL) >= 0) return -1;
+    return createFileIn(dir, name, is_directory);
+}
 
-    cur_directory.file_number--;
-    // Update the directory cache
-    // swap last directory entry into removed & update disk
-    long old_write_pointer = fdt.table[cur_directory.fdt_index].writePointer;
-    if(directory_index != cur_directory.file_number) {
-        cur_directory.file_inode_map[directory_index] = cur_directory.file_inode_map[cur_directory.file_number];
-        // directory is [parent index, DirectoryTableEntry1, DirectoryTableEntry2, ...]
-        fdt.table[cur_directory.fdt_index].writePointer =  sizeof(cur_directory.parent_inode_index)
-                                                           + directory_index * sizeof(DirectoryTableEntry);
-        overwriteData(cur_directory.fdt_index, cur_directory.file_inode_map + directory_index, sizeof(DirectoryTableEntry));
+// Adds files at the given paths (from root). Paths one after another in the same directory are added together,
+// as createDirectoryFiles does, or one at a time if some can't be. Returns the number added (fdt_indices[i] = -1
+// for a path not added)
+int createPathFiles(char** pathNames, int count, int* fdt_indices) {
+    for(int i = 0; i < count; i++) fdt_indices[i] = -1;
+    char (*names)[MAXFILENAME + 1] = malloc(count * sizeof(*names));
+    char** name_list = malloc(count * sizeof(char*));
+    int* parents = malloc(count * sizeof(int));
+    if(names == NULL || name_list == NULL || parents == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate directory entry memory!\n");
+        free(names);
+        free(name_list);
+        free(parents);
+        return -1;
     }
-    fdt.table[cur_directory.fdt_index].writePointer = fdt.inodes[cur_directory.fdt_index].size;
-    deleteData(cur_directory.fdt_index, sizeof(DirectoryTableEntry));
-    // Reset write pointer if it was less than current (which is at updated size)
-    if(old_write_pointer < fdt.table[cur_directory.fdt_index].writePointer) {
-        fdt.table[cur_directory.fdt_index].writePointer = old_write_pointer;
+    for(int i = 0; i < count; i++) {
+        name_list[i] = names[i];
+        parents[i] = resolveParent(pathNames[i], names[i]);
     }
-    
 
-    // Realloc cache size if needed (so we aren't endlessly filling)
-    if(cur_directory.file_number <= cur_directory.table_size - 5 && cur_directory.table_size > 5) {
-        cur_directory.table_size -= 5;
-        DirectoryTableEntry* new_dir_mem = realloc(cur_directory.file_inode_map, cur_directory.table_size * sizeof(DirectoryTableEntry));
-        if(new_dir_mem == NULL) {
-            fprintf(stderr, "ERROR: Unable to deallocate directory cache memory!\n");
+    int added = 0;
+    for(int start = 0; start < count;) {
+        int run = 1;
+        while(start + run < count && parents[start + run] == parents[start]) run++;
+        if(parents[start] >= 0 && createDirectoryFiles(parents[start], name_list + start, run, fdt_indices + start) == run) {
+            added += run;
         } else {
-            cur_directory.file_inode_map = new_dir_mem;
+            for(int i = start; i < start + run; i++) {
+                fdt_indices[i] = createPathFile(pathNames[i], false);
+                if(fdt_indices[i] >= 0) added++;
+            }
         }
+        start += run;
     }
-    return remove;
+    free(names);
+    free(name_list);
+    free(parents);
+    return added;
 }
 
 
-// Remove the file from current directory and disk (public method)
-DirectoryTableEntry removeDirectoryFile(const char* fileName) {
+// Does the actual work of deleting data from directory. Hidden to hide details like stopping iNode deletion
+static DirectoryTableEntry _removeDirectoryFile(Directory* dir, int directory_index, bool delete_data) {
+
+    // Get info about node to remove
+    DirectoryTableEntry remove;
+    int record_length = readEntry(dir, directory_index, &remove);
+
+    // Update the directory (data & index) first: a crash before the iNode is on the orphan list leaks it, instead of
+    // leaving an entry that refers to space about to be freed
+    removeEntry(dir, directory_index, record_length, remove);
+
+    // Delete the iNodes data if needed, recursive delete for subdirectories
+    if(delete_data) {
+        int fdt_index = openFDTNode(remove.inode_index);
+        // Closes the FDT entry (and every other handle on it) too. Space is freed later, see reclaimOrphans
+        if(fdt_index >= 0) deleteTree(fdt_index, true);
+    }
+    return remove;
+}
+
+// Helper - remove the file with given name from dir (and disk if it has no other links)
+static DirectoryTableEntry removeFileIn(Directory* dir, const char* fileName) {
     // Find file
-    int directory_index = getDirectoryIndex(fileName);
-    if(directory_index < 0 ||  directory_index >= cur_directory.file_number) {
+    DirectoryTableEntry entry;
+    int directory_index = findEntry(dir, fileName, &entry);
+    if(directory_index < 0) {
+        return (DirectoryTableEntry) {.inode_index = -1, .name = ""};
+    }
+
+    // The current directory (or a directory above it) can't be removed from under it
+    int fdt_id = openFDTNode(entry.inode_index);
+    if(fdt_id < 0) return (DirectoryTableEntry) {.inode_index = -1, .name = ""};
+    if(fdtNode(fdt_id)->is_directory && holdsCurrentDirectory(entry.inode_index)) {
+        closeFDTNode(fdt_id);
         return (DirectoryTableEntry) {.inode_index = -1, .name = ""};
     }
 
     // If no more references in file system, remove permanently
-    int old_fdt_size = fdt.size;
-    int fdt_id = openFDTNode(cur_directory.file_inode_map[directory_index].inode_index);
-    fdt.inodes[fdt_id].link_count--;
+    fdtNode(fdt_id)->link_count--;
     DirectoryTableEntry removed;
-    if(fdt.inodes[fdt_id].link_count <= 0) {
-        removed = _removeDirectoryFile(directory_index, true);  // Delete iNode, closes fdt too
+    if(fdtNode(fdt_id)->link_count <= 0) {
+        removed = _removeDirectoryFile(dir, directory_index, true);  // Delete iNode, closes every handle on it too
     } else {
-        removed = _removeDirectoryFile(directory_index, false); // Keep iNode, remove directory entry
-        if(fdt.size > old_fdt_size) closeFDTNode(fdt_id);
+        removed = _removeDirectoryFile(dir, directory_index, false); // Keep iNode, remove directory entry
+        saveFDTNode(fdt_id);
+        closeFDTNode(fdt_id);
     }
     return removed;
 }
 
+// Remove the file from the directory with iNode dir_inode and disk (public method)
+DirectoryTableEntry removeDirectoryFile(int dir_inode, const char* fileName) {
+    Directory* dir = getDirectory(dir_inode);
+    if(dir == NULL) return (DirectoryTableEntry) {.inode_index = -1, .name = ""};
+    return removeFileIn(dir, fileName);
+}
 
-// Replace the current directory table with that given by index - returns success status
-bool loadDirectory(int inode_index, bool close_current_directory) {
-    if(cur_directory.fdt_index > -1 && inode_index == fdt.table[cur_directory.fdt_index].inode_idx) return true;
-    // add new directory to FDT
-    int old_fdt_size = fdt.size;
-    int fdt_index = openFDTNode(inode_index);
-    iNode new_dir = fdt.inodes[fdt_index];
-    if(!new_dir.is_directory) {
-        fprintf(stderr, "Attempting to load data file as a directory, load cancelled\n");
-        if(fdt.size > old_fdt_size) closeFDTNode(fdt_index); // If the new wasn't already opened, close
+// Remove the file at the given path (from root) from its directory and disk
+DirectoryTableEntry removePathFile(const char* pathName) {
+    char name[MAXFILENAME + 1];
+    int parent_inode = resolveParent(pathName, name);
+    Directory* dir = (parent_inode < 0) ? NULL : getDirectory(parent_inode);
+    if(dir == NULL) return (DirectoryTableEntry) {.inode_index = -1, .name = ""};
+    return removeFileIn(dir, name);
+}
+
+// Helper - whether the entry replaced may be swapped for the entry moved by a rename: a file for a file, or an 
+// empty directory (not holding the current directory) for a directory
+static bool canReplace(const DirectoryTableEntry* moved, const DirectoryTableEntry* replaced) {
+    if(moved->type != replaced->type) return false;
+    if(replaced->type != ENTRY_DIRECTORY) return true;
+    int fdt_index = openFDTNode(replaced->inode_index);
+    if(fdt_index < 0) return false;
+    DirectoryHeader header;
+    bool empty = readDataAt(fdt_index, &header, sizeof(DirectoryHeader), 0) == sizeof(DirectoryHeader) && header.file_number == 0;
+    closeFDTNode(fdt_index);
+    return empty && !holdsCurrentDirectory(replaced->inode_index);
+}
+
+// Rename (or move) the file or directory at oldPath to newPath, both from root, replacing what newPath names
+// (see canReplace). Only the two entry records change: no data is copied and the current directory is left alone
+bool renamePathFile(const char* oldPath, const char* newPath) {
+    char old_name[MAXFILENAME + 1], new_name[MAXFILENAME + 1];
+    int old_parent = resolveParent(oldPath, old_name);
+    int new_parent = resolveParent(newPath, new_name);
+    if(old_parent < 0 || new_parent < 0 || new_name[0] == '\0') return false;
+
+    DirectoryTableEntry moved;
+    Directory* dir = getDirectory(old_parent);
+    int old_offset = (dir == NULL) ? -1 : findEntry(dir, old_name, NULL);
+    if(old_offset < 0) return false;
+    int old_length = readEntry(dir, old_offset, &moved);
+    if(old_parent == new_parent && strcmp(old_name, new_name) == 0) return true;
+
+    // A directory can't go under itself
+    if(moved.type == ENTRY_DIRECTORY && isWithin(new_parent, moved.inode_index)) return false;
+
+    // Point the new name at the moved iNode: a new record, or the replaced file's record rewritten in place
+    // (same name, so same length and index key)
+    DirectoryTableEntry entry = moved;
+    strcpy(entry.name, new_name);
+    DirectoryTableEntry replaced;
+    dir = getDirectory(new_parent); // May push the old directory out of the cache, fetched again below
+    if(dir == NULL) return false;
+    int new_offset = findEntry(dir, new_name, &replaced);
+    if(new_offset < 0) {
+        if(!addEntry(dir, entry)) return false;
+    } else {
+        if(replaced.inode_index == moved.inode_index) return true; // Both names already link the same file
+        if(!canReplace(&moved, &replaced)) return false;
+        if(!writeRecord(dir, new_offset, &entry, readEntry(dir, new_offset, &replaced))) return false;
+        dentryInsert(new_parent, new_name, moved.inode_index);
+
+        // The replaced file loses a link, and goes once it has none (see removeFileIn)
+        int fdt_id = openFDTNode(replaced.inode_index);
+        if(fdt_id >= 0 && --fdtNode(fdt_id)->link_count <= 0) {
+            deleteTree(fdt_id, true);
+        } else if(fdt_id >= 0) {
+            saveFDTNode(fdt_id);
+            closeFDTNode(fdt_id);
+        }
+    }
+
+    // Drop the old name. Records never move on an add, so old_offset still holds it
+    dir = getDirectory(old_parent);
+    if(dir == NULL) {
+        fprintf(stderr, "ERROR (rename): Unable to reload directory (iNode %d), %s is left linked twice!\n", old_parent, old_name);
         return false;
     }
+    removeEntry(dir, old_offset, old_length, moved);
+    if(moved.type == ENTRY_DIRECTORY && old_parent != new_parent) setParentDirectory(moved.inode_index, new_parent);
+    return true;
+}
 
-    // Close the current directory in FDT
-    if(cur_directory.fdt_index >= 0 && close_current_directory) closeFDTNode(cur_directory.fdt_index);
+// Add a clone of the file at pathName as clonePath (both from root, clonePath must be free). The clone shares the
+// file's data blocks until either is written (see cloneINode) - returns file descriptor table index of the clone
+int clonePathFile(const char* pathName, const char* clonePath) {
+    char name[MAXFILENAME + 1];
+    int parent_inode = resolveParent(clonePath, name);
+    if(parent_inode < 0 || name[0] == '\0') return -1;
+    int src_file = fdtOpenFullPathFile(pathName);
+    if(src_file < 0) return -1;
+    if(fdtNode(src_file)->is_directory) {
+        closeFDTNode(src_file);
+        return -1;
+    }
+    Directory* dir = getDirectory(parent_inode);
+    int fdt_index = (dir == NULL || findEntry(dir, name, NULL) >= 0) ? -1 : cloneINode(src_file);
+    closeFDTNode(src_file);
+    if(fdt_index < 0) return -1;
 
-    int new_table_size = new_dir.size - sizeof(cur_directory.parent_inode_index);
-    int new_num_files = new_table_size / sizeof(DirectoryTableEntry);
-    
-    // Change cur_directory cache values
-    if(new_table_size > 0) {
-        DirectoryTableEntry* new_dir_mem = realloc(cur_directory.file_inode_map, new_table_size);
-        if(new_dir_mem == NULL) {
-            fprintf(stderr, "ERROR (Load directory): Unable to allocate directory cache memory (size %d)!\n", new_table_size);
-            return false;
+    DirectoryTableEntry entry = {.inode_index = fdt.table[fdt_index].inode_idx, .type = ENTRY_FILE};
+    strcpy(entry.name, name);
+    if(!addEntry(dir, entry)) {
+        deleteTree(fdt_index, false);
+        return -1;
+    }
+    return fdt_index;
+}
+
+// Add a new name linkPath for the file at pathName (both from root, linkPath must be free) - a hard link to the
+// same iNode. Directories can't be linked. Returns success
+bool linkPathFile(const char* pathName, const char* linkPath) {
+    char name[MAXFILENAME + 1];
+    int parent_inode = resolveParent(linkPath, name);
+    if(parent_inode < 0 || name[0] == '\0') return false;
+    int fdt_index = fdtOpenFullPathFile(pathName);
+    if(fdt_index < 0) return false;
+    Directory* dir = fdtNode(fdt_index)->is_directory ? NULL : getDirectory(parent_inode);
+    bool linked = dir != NULL && findEntry(dir, name, NULL) < 0;
+
+    // Count goes up first, so a failure part way leaves an extra count rather than an entry with no count
+    if(linked) {
+        DirectoryTableEntry entry = {.inode_index = fdt.table[fdt_index].inode_idx, .type = ENTRY_FILE};
+        strcpy(entry.name, name);
+        fdtNode(fdt_index)->link_count++;
+        saveFDTNode(fdt_index);
+        linked = addEntry(dir, entry);
+        if(!linked) {
+            fdtNode(fdt_index)->link_count--;
+            saveFDTNode(fdt_index);
         }
-        cur_directory.file_inode_map = new_dir_mem;
     }
+    closeFDTNode(fdt_index);
+    return linked;
+}
+
+
+// Records of a directory read ahead for a listing: the rest of the block holding the next record (plus the block
+// after when a record runs into it), so a listing reads each directory block about once instead of once per entry
+struct DirectoryWindow {
+    char* records;        // Bytes of the directory file from start on (room for two blocks)
+    long capacity;        // Bytes records has room for
+    int dir_inode;        // Directory read into records (-1 if none)
+    long start;           // Offset in the directory file of records[0]
+    long size;            // Bytes read into records
+    unsigned int changes; // directory_changes when read, the records are stale once it moves on
+};
+
+// Free a listing window (NULL is fine)
+void freeDirectoryWindow(DirectoryWindow* window) {
+    if(window == NULL) return;
+    free(window->records);
+    free(window);
+}
+
+// Helper - read dir from offset to the end of its block (or of the next block with next_block) into window
+// Returns success
+static bool fillWindow(Directory* dir, DirectoryWindow* window, long offset, bool next_block) {
+    long end = (offset / super_block.block_size + (next_block ? 2 : 1)) * super_block.block_size;
+    if(end > dir->header.entries_end) end = dir->header.entries_end;
+    window->dir_inode = -1;
+    if(window->capacity < 2L * super_block.block_size) {
+        char* records = realloc(window->records, 2L * super_block.block_size);
+        if(records == NULL) return false;
+        window->records = records;
+        window->capacity = 2L * super_block.block_size;
+    }
+    if(readDataAt(dir->fdt_index, window->records, end - offset, offset) != end - offset) return false;
+    *window = (DirectoryWindow) {.records = window->records, .capacity = window->capacity, .dir_inode = dir->inode_index,
+                                 .start = offset, .size = end - offset, .changes = directory_changes};
+    return true;
+}
+
+// Helper - read the record (live or free) at offset of dir through window, reading the window again only if it
+// doesn't hold the record. Returns its length, or 0 if there is no record there
+static int readWindowEntry(Directory* dir, DirectoryWindow* window, long offset, DirectoryTableEntry* entry) {
+    if(offset < (long) sizeof(DirectoryHeader) || offset >= dir->header.entries_end) return 0;
+    bool held = window->dir_inode == dir->inode_index && window->changes == directory_changes
+                && offset >= window->start && offset < window->start + window->size;
+    if(!held && !fillWindow(dir, window, offset, false)) return 0;
+    long window_end = window->start + window->size;
+    int record_length = parseRecord(window->records + (offset - window->start), window_end - offset, entry);
+    if(record_length == 0 && window_end < dir->header.entries_end) {
+        // The record runs on into the next block
+        if(!fillWindow(dir, window, offset, true)) return 0;
+        record_length = parseRecord(window->records, window->size, entry);
+    }
+    return record_length;
+}
+
+// Read the first live entry at or after position of the directory with iNode dir_inode - returns the position after it,
+// or -1 at the end. Records are read through *window (made on first use), kept by the caller between calls
+int nextDirectoryEntry(int dir_inode, int position, DirectoryTableEntry* entry, DirectoryWindow** window) {
+    Directory* dir = getDirectory(dir_inode);
+    if(dir == NULL) return -1;
+    if(*window == NULL) {
+        *window = calloc(1, sizeof(DirectoryWindow));
+        if(*window == NULL) {
+            fprintf(stderr, "ERROR: Unable to allocate directory listing memory!\n");
+            return -1;
+        }
+        (*window)->dir_inode = -1;
+    }
+    if(position < (int) sizeof(DirectoryHeader)) position = sizeof(DirectoryHeader);
+    int record_length;
+    while((record_length = readWindowEntry(dir, *window, position, entry)) > 0) {
+        position += record_length;
+        if(entry->type != ENTRY_FREE) return position;
+    }
+    return -1;
+}
 
-    cur_directory.file_number = new_num_files;
-    cur_directory.table_size = new_num_files;
-    cur_directory.fdt_index = fdt_index;
 
-    // Update cur_directory cache values with iNode data block (parent index and name/index map)
-    char* info_buffer = malloc(new_dir.size);
-    readData(fdt_index, info_buffer, new_dir.size);
-    memcpy(&(cur_directory.parent_inode_index), info_buffer, sizeof(cur_directory.parent_inode_index));
-    memcpy(cur_directory.file_inode_map, info_buffer + sizeof(cur_directory.parent_inode_index), new_table_size);
-    fdt.table[fdt_index].readPointer = 0;
-    fdt.table[fdt_index].writePointer = new_dir.size;
-    free(info_buffer);
+// Helper - read the iNode table blocks of every entry of dir into the iNode cache. The records are read in one go
+static void prefetchEntries(Directory* dir) {
+    if(dir->header.file_number <= 0) return;
+    long size = dir->header.entries_end - sizeof(DirectoryHeader);
+    int* inodes = malloc(dir->header.file_number * sizeof(int));
+    char* records = malloc(size + 1);
+    if(inodes == NULL || records == NULL || readDataAt(dir->fdt_index, records, size, sizeof(DirectoryHeader)) != size) {
+        free(inodes); // Only an optimization
+        free(records);
+        return;
+    }
+
+    DirectoryTableEntry entry;
+    int count = 0;
+    int record_length;
+    for(long offset = 0; count < dir->header.file_number && (record_length = parseRecord(records + offset, size - offset, &entry)) > 0;
+        offset += record_length) {
+        if(entry.type != ENTRY_FREE) inodes[count++] = entry.inode_index;
+    }
+    prefetchINodes(inodes, count);
+    free(inodes);
+    free(records);
+}
 
+// Load the directory with given iNode into the directory cache (to become a current directory) - returns success status
+bool loadDirectory(int inode_index, bool prefetch) {
+    Directory* dir = getDirectory(inode_index);
+    if(dir == NULL) return false;
+    if(prefetch) prefetchEntries(dir);
     return true;
 }
 
+// iNode of the parent of the directory with given iNode, or -1 for the root (or if it can't be loaded)
+int parentDirectory(int inode_index) {
+    Directory* dir = getDirectory(inode_index);
+    return (dir == NULL) ? -1 : dir->header.parent_inode_index;
+}
+
 
 // UNUSED: We didn't need subdirectories, and so it wasn't tested (likely has bugs)
 // Copies a file from one directory to another. 'moveToPath' must be full path, see fdtOpenFullPathFile
-bool copyDirectoryFile(const char* fileName, const char* moveToPath) {
-    // Current directory info
-    int old_dir_idx = getDirectoryIndex(fileName);
-    int old_dir_inode = fdt.table[cur_directory.fdt_index].inode_idx; // To load back later
-    if (old_dir_idx < 0) return false;
-    // Curent file info
-    int old_fdt_size = fdt.size; // Keep track of whether open imported new files (do we need to close)
-    int old_file_inode = cur_directory.file_inode_map[old_dir_idx].inode_index;
-    int old_file = openFDTNode(old_file_inode);
-    bool close_old = fdt.size > old_fdt_size;
+bool copyDirectoryFile(int dir_inode, const char* fileName, const char* moveToPath) {
+    // Current file info
+    DirectoryTableEntry old_entry;
+    Directory* dir = getDirectory(dir_inode);
+    if (dir == NULL || findEntry(dir, fileName, &old_entry) < 0) return false;
+    int old_file = openFDTNode(old_entry.inode_index);
+    if(old_file < 0) return false;
+
+    // TODO: Recursive copy. Copying a directory's bytes would share its name index
+    if(fdtNode(old_file)->is_directory) {
+        closeFDTNode(old_file);
+        return false;
+    }
 
     // Not moving to directory check
     int new_file_dir = fdtOpenFullPathFile(moveToPath);
-    if(!fdt.inodes[new_file_dir].is_directory) {
-        closeFDTNode(new_file_dir);
-        if(close_old) closeFDTNode(old_file);
+    if(new_file_dir < 0 || !fdtNode(new_file_dir)->is_directory) {
+        if(new_file_dir >= 0) closeFDTNode(new_file_dir);
+        closeFDTNode(old_file);
+        return false;
+    }
+    Directory* new_dir = getDirectory(fdt.table[new_file_dir].inode_idx);
+    closeFDTNode(new_file_dir);
+    if(new_dir == NULL) {
+        closeFDTNode(old_file);
         return false;
     }
 
-    // First read data from current directory
-    long save_data_size = fdt.inodes[old_file].size;
-    char* copy_from_buf = malloc(fdt.inodes[old_file].size);
-    long past_read_pointer = fdt.table[old_file].readPointer;
-    fdt.table[old_file].readPointer = 0;
-    readData(old_file, copy_from_buf, fdt.inodes[old_file].size);
-    fdt.table[old_file].readPointer = past_read_pointer;
-    if(close_old) closeFDTNode(old_file);
-
-    // Loading new directory & add entry
-    loadDirectory(fdt.table[new_file_dir].inode_idx, true);
-
+    // Add entry to new directory
     char new_name[MAXFILENAME + 1];
     strcpy(new_name, fileName);
-    while(getDirectoryIndex(new_name) > 0) {
+    while(findEntry(new_dir, new_name, NULL) >= 0) {
         if(strlen(new_name) + 2 > MAXFILENAME) {
-            if (close_old) closeFDTNode(old_file);
-            free(copy_from_buf);
-            loadDirectory(old_dir_inode, true);
+            closeFDTNode(old_file);
             return false;
         }
         strcat(new_name, "_c");
     }
-    int new_file = createDirectoryFile(new_name, fdt.inodes[old_file].is_directory);
+    int new_file = createFileIn(new_dir, new_name, false);
     
-    // Write data to new directory file
-    old_fdt_size = fdt.size;
-    overwriteData(new_file, copy_from_buf, save_data_size);
-    free(copy_from_buf);
-    if(fdt.size > old_fdt_size) closeFDTNode(new_file);
-    if (close_old) closeFDTNode(old_file);
-    return true;
+    // Stream the data across (bounded buffer, not the whole file)
+    if(new_file >= 0) {
+        copyDataAt(old_file, 0, new_file, 0, fdtNode(old_file)->size);
+        closeFDTNode(new_file);
+    }
+    closeFDTNode(old_file);
+    return new_file >= 0;
 }
 
 // TODO: Recursive move/copy
 
 // UNUSED: We didn't need subdirectories, and so it wasn't tested (likely has bugs)
 // Moves a file from one directory to another. 'moveToPath' must be full path, see fdtOpenFullPathFile
-bool moveDirectoryFile(const char* fileName, const char* moveToPath, bool copy) {
-    // Current directory info
-    int old_dir_idx = getDirectoryIndex(fileName);
-    int old_dir_inode = fdt.table[cur_directory.fdt_index].inode_idx; // To load back later
+bool moveDirectoryFile(int dir_inode, const char* fileName, const char* moveToPath, bool copy) {
+    // Current file info
+    DirectoryTableEntry old_entry;
+    Directory* dir = getDirectory(dir_inode);
+    int old_dir_idx = (dir == NULL) ? -1 : findEntry(dir, fileName, &old_entry);
     if (old_dir_idx < 0) return false; 
-    // Curent file info
-    int old_fdt_size = fdt.size; // Keep track of whether open imported new files (do we need to close)
-    int old_file_inode = cur_directory.file_inode_map[old_dir_idx].inode_index;
-    int old_file = openFDTNode(old_file_inode);
-    bool close_old = fdt.size > old_fdt_size;
+    int old_file = openFDTNode(old_entry.inode_index);
+    if(old_file < 0) return false;
 
     // Not moving to directory check
     // TODO: Must be sure new file dir != subdirectory of current
     int new_file_dir = fdtOpenFullPathFile(moveToPath);
-    if(!fdt.inodes[new_file_dir].is_directory) {
-        closeFDTNode(new_file_dir);
-        if(close_old) closeFDTNode(old_file);
+    if(new_file_dir < 0 || !fdtNode(new_file_dir)->is_directory) {
+        if(new_file_dir >= 0) closeFDTNode(new_file_dir);
+        closeFDTNode(old_file);
         return false;
     }
+    int new_dir_inode = fdt.table[new_file_dir].inode_idx;
+    Directory* new_dir = getDirectory(new_dir_inode);
+    closeFDTNode(new_file_dir);
+    if(new_dir == NULL || new_dir_inode == dir_inode) {
+        closeFDTNode(old_file);
+        return new_dir != NULL; // Already there
+    }
 
-    // Load new directory & create entry
-    DirectoryTableEntry new_entry = _removeDirectoryFile(old_dir_idx, false);
-    loadDirectory(fdt.table[new_file_dir].inode_idx, true);
-    strcpy(new_entry.name, fileName);
-    while(getDirectoryIndex(new_entry.name) > 0) {
+    // Find a free name in the new directory
+    DirectoryTableEntry new_entry = old_entry;
+    while(findEntry(new_dir, new_entry.name, NULL) >= 0) {
         if(strlen(new_entry.name) + 2 > MAXFILENAME) {
-            if (close_old) closeFDTNode(old_file);
-            loadDirectory(old_dir_inode, true);
+            closeFDTNode(old_file);
             return false;
         }
         strcat(new_entry.name, "_c");
     }
 
-    // Add a new directory entry pointing to old iNode index
-    if(cur_directory.file_number == cur_directory.table_size) {
-        cur_directory.table_size += 5;
-        DirectoryTableEntry* new_dir_mem = realloc(cur_directory.file_inode_map, cur_directory.table_size * sizeof(DirectoryTableEntry));
-        if(new_dir_mem == NULL) {
-            fprintf(stderr, "ERROR  (move file): Unable to allocate directory cache memory!\n");
-            if (close_old) closeFDTNode(old_file);
-            loadDirectory(old_dir_inode, true);
-            return false;
-        }
-        cur_directory.file_inode_map = new_dir_mem;
+    // Add a new directory entry pointing to old iNode index, then drop the old one
+    if(!addEntry(new_dir, new_entry)) {
+        fprintf(stderr, "ERROR  (move file): Unable to add directory entry!\n");
+        closeFDTNode(old_file);
+        return false;
     }
-    cur_directory.file_inode_map[cur_directory.file_number] = new_entry;
-    overwriteData(cur_directory.fdt_index, cur_directory.file_inode_map + cur_directory.file_number, sizeof(DirectoryTableEntry));
-    cur_directory.file_number++;
+    dir = getDirectory(dir_inode); // May have been pushed out of the cache by the path lookup
+    if(dir != NULL) _removeDirectoryFile(dir, old_dir_idx, false);
+
+    // A moved directory has a new parent
+    if(fdtNode(old_file)->is_directory) setParentDirectory(old_entry.inode_index, new_dir_inode);
 
     // Cleanup
-    loadDirectory(old_dir_inode, true);
-    if(fdt.size > old_fdt_size) closeFDTNode(old_file);
+    closeFDTNode(old_file);
     return true;
-}
\ No newline at end of file
+}
@@ -6,46 +6,136 @@
 #include "sfs_api.h" // Need for MAXFILENAME
 
 
+// Entry types, stored in the directory so a listing can tell files & directories apart without loading iNodes
+#define ENTRY_FREE 0
+#define ENTRY_FILE 1
+#define ENTRY_DIRECTORY 2
+
+// Returned by cachedPathINode when a directory on the path isn't cached (opening it needs fs_lock exclusive)
+#define PATH_NOT_CACHED -2
+
+// A directory entry in memory
 typedef struct DirectoryTableEntry {
     char name[MAXFILENAME + 1]; // Include null terminate
     int inode_index;
+    unsigned char type;         // ENTRY_FILE or ENTRY_DIRECTORY (ENTRY_FREE for a free record)
 } DirectoryTableEntry;
 
+// On-disk entry record: this, then the name (not null terminated), padded to a multiple of RECORD_ALIGN bytes
+typedef struct EntryRecord {
+    int inode_index;              // iNode of the entry (offset of the next free record of this length if free)
+    unsigned short record_length; // Bytes in the whole record
+    unsigned char type;           // ENTRY_FREE, ENTRY_FILE or ENTRY_DIRECTORY
+    unsigned char name_length;
+} EntryRecord;
 
-struct Directory_s {
+#define RECORD_ALIGN 8
+#define MAX_RECORD_LENGTH ((sizeof(EntryRecord) + MAXFILENAME + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN)
+#define FREE_LISTS (MAX_RECORD_LENGTH / RECORD_ALIGN)
+
+
+// On-disk header at the start of every directory file. Entry records follow it back to back (in creation order),
+// a removed entry leaves a free record that a later entry of about the same length reuses
+typedef struct DirectoryHeader {
     int parent_inode_index; // Need on disk so a child can load its parent 
-    DirectoryTableEntry* file_inode_map;
+    int file_number;        // Number of directory entries
+    int entries_end;        // Byte offset of the end of the last record
+    int free_bytes;         // Bytes in free records
+    int free_records[FREE_LISTS]; // First free record of each length (record_length / RECORD_ALIGN - 1), -1 if none
+    int index_inode;        // iNode of the name index: a B+tree of (name hash, entry slot) in block sized nodes
+    int index_root;         // Block (in the index file) of the B+tree root
+    int index_blocks;       // Blocks in the index file
+} DirectoryHeader;
 
-    // For cache only
-    int file_number; // Number of directory entries
-    int table_size;  // size allocated to map (in TableEntries)
-    int fdt_index;   // file descriptor index of current directory (dir needs read/write pointer)
+
+// A loaded directory (in the directory cache). Only the header is cached, entries are read from disk through the index
+struct Directory_s {
+    DirectoryHeader header;
+    int fdt_index;   // file descriptor index of the directory
+    int index_fdt;   // file descriptor index of the directory's name index
+    int inode_index; // iNode of the directory (-1 if cache slot unused)
+    unsigned int last_used; // For replacing the least recently used directory in the cache
 };
 typedef struct Directory_s Directory;
 
-extern Directory cur_directory;
-extern FileDescriptorTable fdt;
+// NOTE: Names (not paths) are relative to a directory given by its iNode, the current directory of a session
 
-// Loads the given path name into fdt table
+// Loads the given path name into fdt table, without changing the current directory
 // pathName = path to open (starting from file in root dir). Returns fdt index
 int fdtOpenFullPathFile(const char* pathName);
 
-// Opens the given file in the FDT and returns the FDT index
-int openDirectoryFile(const char* fileName);
+// iNode of the given path name (from root) without opening it, -1 if missing. fullPathINode opens directories on the
+// way as needed, cachedPathINode only uses cached ones (safe with fs_lock shared) and returns PATH_NOT_CACHED otherwise
+int fullPathINode(const char* pathName);
+int cachedPathINode(const char* pathName);
+
+// Opens the given file of the directory with iNode dir_inode in the FDT and returns the FDT index
+int openDirectoryFile(int dir_inode, const char* fileName);
 
-// UNUSED: Move directory file from current directory to given path (from a root file). Returns true on success
+// UNUSED: Move directory file from the directory with iNode dir_inode to given path (from a root file). Returns true on success
 // If copy==true, a copy will be made in the new directory. Else the file will just be moved
-bool moveDirectoryFile(const char* fileName, const char* moveToPath, bool copy);
+bool moveDirectoryFile(int dir_inode, const char* fileName, const char* moveToPath, bool copy);
+
+// Adds a file with given name to the directory with iNode dir_inode (-1 to create the root directory)
+int createDirectoryFile(int dir_inode, const char* name, bool is_directory);
+
+// Adds files with the given names to the directory with iNode dir_inode, creating their iNodes and entries together
+// Returns count with the fdt indices in fdt_indices, or -1 with nothing added (name empty, taken or repeated, or no space)
+int createDirectoryFiles(int dir_inode, char** names, int count, int* fdt_indices);
+
+// Adds a file at the given path (from root) to its directory, without changing the current directory
+int createPathFile(const char* pathName, bool is_directory);
+
+// Adds files at the given paths (from root). A run of paths in one directory is added together (as createDirectoryFiles),
+// or one at a time if some can't be. Returns the number added, with fdt_indices[i] = -1 for each path not added
+int createPathFiles(char** pathNames, int count, int* fdt_indices);
+
+// Remove the file in the directory with iNode dir_inode and disk. A directory that is (or holds) the current
+// directory of a session can't be removed
+DirectoryTableEntry removeDirectoryFile(int dir_inode, const char* fileName);
+
+// Remove the file at the given path (from root) from its directory and disk, without changing the current directory
+DirectoryTableEntry removePathFile(const char* pathName);
+
+// Rename (or move) the file or directory at oldPath to newPath (both from root), replacing a file or empty directory
+// already at newPath. Only the two directory entries change. Returns success
+bool renamePathFile(const char* oldPath, const char* newPath);
+
+// Add a copy-on-write clone of the file at pathName as clonePath (both from root), sharing its data blocks
+// Returns the clone's fdt index, or -1 if clonePath is taken or the disk is full
+int clonePathFile(const char* pathName, const char* clonePath);
+
+// Add linkPath (from root) as another name of the file at pathName: both entries refer to one iNode, which is
+// deleted once its last entry is removed. Returns success (fails for directories or if linkPath is taken)
+bool linkPathFile(const char* pathName, const char* linkPath);
+
+// Read the first entry at or after the given position (0 for the start) of the directory with iNode dir_inode
+// Returns the position after the entry read (to continue from), or -1 at the end of the directory
+// Records are read a block at a time into *window (NULL to start, made on first use), which the lister keeps
+// between calls and frees with freeDirectoryWindow
+int nextDirectoryEntry(int dir_inode, int position, DirectoryTableEntry* entry, DirectoryWindow** window);
+void freeDirectoryWindow(DirectoryWindow* window);
+
+// Whether the directory with iNode dir_inode is cached, so nextDirectoryEntry only needs fs_lock shared for it
+bool directoryCached(int dir_inode);
+
+// Empty the directory cache and the cache of resolved path components (call when a file system is created or loaded)
+void resetDirectoryCaches();
 
-// Adds a file with given name to the directory
-int createDirectoryFile(const char* name, bool is_directory);
+// Make the (empty) directory caches of a new file system (NULL if out of memory), or free those of one unmounted
+DirectoryCaches* newDirectoryCaches();
+void freeDirectoryCaches(DirectoryCaches* caches);
 
-// NOTE: Avoid referencing 1 file in multiple directories for now, I have not worked out the remove logic
+// Load the directory with given iNode into the directory cache (checking it is a directory), to become a current directory
+// With prefetch, the iNodes of its entries are read into the iNode cache too
+bool loadDirectory(int inode_index, bool prefetch);
 
-// Remove the file in directory and disk
-DirectoryTableEntry removeDirectoryFile(const char* fileName);
+// iNode of the parent of the directory with given iNode (-1 for the root)
+int parentDirectory(int inode_index);
 
-// Replace the current directory table with that given by index (parameter for whether to close current FDT)
-bool loadDirectory(int inode_index, bool close_current_directory);
+// Mark the directory with given iNode as the current directory of one more session, or one less (unpin). Pinned
+// directories and the directories above them can't be removed or replaced. pinDirectory returns success
+bool pinDirectory(int inode_index);
+void unpinDirectory(int inode_index);
 
 #endif
\ No newline at end of file
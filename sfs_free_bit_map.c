@@ -4,67 +4,152 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
 #include "disk_emu.h"
 
-// 'private' - limit scope to current file
-static unsigned char* free_bit_map = NULL; // One free bit map for [inode_bits, data_bits]
-static int data_num_bytes = 0;
-static int inode_num_bytes = 0;
-static int total_num_bytes = 0;
+// 'private' - the map of one file system, used through the names below (those of the calling thread's file system)
+struct FreeBitMap {
+    unsigned char* free_bit_map; // One free bit map for [inode_bits, data_bits]
+    int data_num_bytes;
+    int inode_num_bytes;
+    int total_num_bytes;
 
-void saveFreeBitMapToDisk() {
+    // Extra references to each data block (0 = one owner), for blocks shared between cloned files.
+    // Kept in the blocks before the free bit map, one byte per data block (refs_num_blocks whole blocks in memory too)
+    unsigned char* block_refs;
+    int data_num_blocks;
+    int refs_num_blocks;
+    bool refs_dirty; // block_refs changed since last save
+    bool map_dirty;  // Saved while saves were held, not written yet
+
+    // Data blocks (global disk position) and iNodes (as -1 - index) freed while saves were held. They stay in use
+    // in the map until flushHeldFrees, once the iNodes that referred to them are on disk
+    int* held_frees;
+    int held_free_count;
+    int held_free_allocated;
+
+    // Held by every public call after the map is created or loaded, so threads writing different files
+    // can allocate and free blocks at the same time
+    pthread_mutex_t bit_map_lock;
+};
+
+FreeBitMap* newFreeBitMap() {
+    FreeBitMap* map = calloc(1, sizeof(FreeBitMap));
+    if(map == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate free bit map memory!\n");
+        return NULL;
+    }
+    pthread_mutex_init(&map->bit_map_lock, NULL);
+    return map;
+}
+
+void freeFreeBitMap(FreeBitMap* map) {
+    if(map == NULL) return;
+    free(map->free_bit_map);
+    free(map->block_refs);
+    free(map->held_frees);
+    pthread_mutex_destroy(&map->bit_map_lock);
+    free(map);
+}
+
+#define free_bit_map (cur_fs->bit_map->free_bit_map)
+#define data_num_bytes (cur_fs->bit_map->data_num_bytes)
+#define inode_num_bytes (cur_fs->bit_map->inode_num_bytes)
+#define total_num_bytes (cur_fs->bit_map->total_num_bytes)
+#define block_refs (cur_fs->bit_map->block_refs)
+#define data_num_blocks (cur_fs->bit_map->data_num_blocks)
+#define refs_num_blocks (cur_fs->bit_map->refs_num_blocks)
+#define refs_dirty (cur_fs->bit_map->refs_dirty)
+#define map_dirty (cur_fs->bit_map->map_dirty)
+#define held_frees (cur_fs->bit_map->held_frees)
+#define held_free_count (cur_fs->bit_map->held_free_count)
+#define held_free_allocated (cur_fs->bit_map->held_free_allocated)
+#define bit_map_lock (cur_fs->bit_map->bit_map_lock)
+
+// Data blocks of a file system with the given geometry: the blocks left after the super block, the iNode table,
+// the free bit map and the reference counts (a byte per data block, in as many blocks as that takes)
+int dataBlockCount(const SuperBlock* geometry) {
+    int blocks = geometry->file_system_size - geometry->inode_table_length - 2; // Data and reference count blocks
+    int refs_blocks = (blocks + geometry->block_size) / (geometry->block_size + 1); // Each data block adds a byte
+    return blocks - refs_blocks;
+}
+
+// Helper - first block of the reference counts (they run up to the free bit map)
+static int refsStart() {
+    return super_block.file_system_size - 1 - refs_num_blocks;
+}
+
+// Helper - set the sizes of the map & reference counts for the loaded super block and allocate them (counts zeroed)
+static void sizeFreeBitMap() {
+    int data_blocks = dataBlockCount(&super_block);
+    int inodes = super_block.inode_table_length * INODES_PER_BLOCK;
+
+    inode_num_bytes = inodes / 8 +  (inodes % 8 != 0);
+    data_num_bytes  = data_blocks / 8 +  (data_blocks % 8 != 0);
+    total_num_bytes = data_num_bytes + inode_num_bytes;
+
+    free(free_bit_map);
+    free_bit_map = malloc(total_num_bytes);
+    data_num_blocks = data_blocks;
+    refs_num_blocks = super_block.file_system_size - super_block.inode_table_length - 2 - data_blocks;
+    free(block_refs);
+    block_refs = calloc((size_t) refs_num_blocks * super_block.block_size, 1);
+    held_free_count = 0;
+}
+
+// Helper - write the map (and reference counts if changed) to disk, bit_map_lock held or no other threads
+static void writeFreeBitMap() {
     char* buff = malloc(super_block.block_size);
     memcpy(buff, free_bit_map, total_num_bytes);
     write_blocks(super_block.file_system_size - 1, 1, buff);
+    if(refs_dirty) {
+        write_blocks(refsStart(), refs_num_blocks, block_refs);
+        refs_dirty = false;
+    }
     free(buff);
 }
 
+void saveFreeBitMapToDisk() {
+    pthread_mutex_lock(&bit_map_lock);
+    if(cur_fs->saves_held > 0) map_dirty = true;
+    else writeFreeBitMap();
+    pthread_mutex_unlock(&bit_map_lock);
+}
+
+void flushFreeBitMap() {
+    pthread_mutex_lock(&bit_map_lock);
+    if(map_dirty) writeFreeBitMap();
+    map_dirty = false;
+    pthread_mutex_unlock(&bit_map_lock);
+}
+
 // expects free bit to be alloced (and config vars = num_bytes per section)
 static void readFreeBitMapFromDisk() {
     char* buff = malloc(super_block.block_size);
     read_blocks(super_block.file_system_size - 1, 1, buff);
     memcpy(free_bit_map, buff, total_num_bytes);
+    read_blocks(refsStart(), refs_num_blocks, block_refs);
     free(buff);
 }
 
 void createFreeBitMap() {
-    // Discount inodes, super block, and free bit block
-    int data_blocks = super_block.file_system_size - super_block.inode_table_length - 2; 
-    int inodes = super_block.inode_table_length * INODES_PER_BLOCK;
+    sizeFreeBitMap(); // Nothing shared
+    int extra_inode_bits = (super_block.inode_table_length * INODES_PER_BLOCK) % 8;
+    int extra_data_bits = data_num_blocks % 8;
 
-    inode_num_bytes = inodes / 8;
-    int extra_inode_bits = inodes % 8;
-    inode_num_bytes += (extra_inode_bits != 0);
-
-    data_num_bytes =  data_blocks / 8;
-    int extra_data_bits = data_blocks % 8; 
-    data_num_bytes += (extra_data_bits != 0);
- 
-    total_num_bytes = data_num_bytes + inode_num_bytes;
-
-    free(free_bit_map);
-    free_bit_map = malloc(total_num_bytes);
     memset(free_bit_map, 255UL, total_num_bytes); // Init all freed 
+    refs_dirty = true;
 
     // zero the extra bits in the map - the excess when allocating 8 more
     if(extra_inode_bits != 0) free_bit_map[inode_num_bytes - 1] &= (255UL << (8-extra_inode_bits));
     if(extra_data_bits != 0) free_bit_map[total_num_bytes - 1] &= (255UL <<  (8-extra_data_bits));
 
-    saveFreeBitMapToDisk();
+    writeFreeBitMap();
 }
 
 void loadFreeBitMap() {
-    // Discount inodes, super block, and free bit block
-    int data_blocks = super_block.file_system_size - super_block.inode_table_length - 2; 
-    int inodes = super_block.inode_table_length * INODES_PER_BLOCK;
-    
-    int inode_num_bytes = inodes / 8 +  (inodes % 8 != 0);
-    int data_num_bytes  = data_blocks / 8 +  (data_blocks % 8 != 0);
-
-    total_num_bytes = data_num_bytes + inode_num_bytes;
-
-    free(free_bit_map);
-    free_bit_map = malloc(total_num_bytes);
+    sizeFreeBitMap();
     readFreeBitMapFromDisk();
 }
 
@@ -101,24 +186,80 @@ static void free_bit(int idx, bool is_inode) {
 
 // data grab returns open block index in global disk position
 int grab_data_bit() {
+    pthread_mutex_lock(&bit_map_lock);
     int idx = grab_bit(false);
+    pthread_mutex_unlock(&bit_map_lock);
     int block_idx = (idx < 0) ? idx : idx + 1 + super_block.inode_table_length;
     return block_idx; 
 }
 
 // iNode grab returns open node index in iNode table position (first iNode = 0)
 int grab_inode_bit() {
-    return grab_bit(true);
+    pthread_mutex_lock(&bit_map_lock);
+    int idx = grab_bit(true);
+    pthread_mutex_unlock(&bit_map_lock);
+    return idx;
+}
+
+// Helper - while saves are held, keep a free (data block index, or -1 - iNode index) back until flushHeldFrees
+// Returns false if saves aren't held (or out of memory), for the caller to free it now. bit_map_lock held
+static bool holdFree(int freed) {
+    if(cur_fs->saves_held == 0) return false;
+    if(held_free_count == held_free_allocated) {
+        int allocated = (held_free_allocated == 0) ? 64 : held_free_allocated * 2;
+        int* frees = realloc(held_frees, allocated * sizeof(int));
+        if(frees == NULL) {
+            fprintf(stderr, "ERROR: Unable to allocate free bit map memory!\n");
+            return false;
+        }
+        held_frees = frees;
+        held_free_allocated = allocated;
+    }
+    held_frees[held_free_count++] = freed;
+    return true;
 }
 
-// free block index (in global disk position)
+// Helper - free the data block at rel_idx (relative to the data bits), or drop a reference if shared. bit_map_lock held
+static void freeDataBlock(int rel_idx) {
+    if(block_refs[rel_idx] > 0) {
+        block_refs[rel_idx]--;
+        refs_dirty = true;
+    } else {
+        free_bit(rel_idx, false);
+    }
+}
+
+// free block index (in global disk position). A shared block just loses a reference
 void free_data_bit(int block_index) {
     int rel_idx = block_index - 1 - super_block.inode_table_length;
-    if (block_index >= (super_block.file_system_size-1) || rel_idx < 0) {
+    if (rel_idx >= data_num_blocks || rel_idx < 0) {
         fprintf(stderr, "Freeing block %d out of system range\n", block_index);
         return;
     }
-    free_bit(rel_idx, false);
+    pthread_mutex_lock(&bit_map_lock);
+    if(!holdFree(block_index)) freeDataBlock(rel_idx);
+    pthread_mutex_unlock(&bit_map_lock);
+}
+
+// Add a reference to the data block at block_index (in global disk position). False if it has as many as it can hold
+bool share_data_bit(int block_index) {
+    int rel_idx = block_index - 1 - super_block.inode_table_length;
+    pthread_mutex_lock(&bit_map_lock);
+    bool shared = (block_refs[rel_idx] < UCHAR_MAX);
+    if(shared) {
+        block_refs[rel_idx]++;
+        refs_dirty = true;
+    }
+    pthread_mutex_unlock(&bit_map_lock);
+    return shared;
+}
+
+// Whether more than one file refers to the data block at block_index (in global disk position)
+bool data_bit_shared(int block_index) {
+    pthread_mutex_lock(&bit_map_lock);
+    bool shared = block_refs[block_index - 1 - super_block.inode_table_length] > 0;
+    pthread_mutex_unlock(&bit_map_lock);
+    return shared;
 }
 
 // free node index (in iNode table position | first iNode = 0)
@@ -127,13 +268,28 @@ void free_inode_bit(int inode_index) {
         fprintf(stderr, "Freeing inode %d out of system range\n", inode_index);
         return;
     }
-    free_bit(inode_index, true);
+    pthread_mutex_lock(&bit_map_lock);
+    if(!holdFree(-1 - inode_index)) free_bit(inode_index, true);
+    pthread_mutex_unlock(&bit_map_lock);
+}
+
+// Apply the frees held back while saves were held (see holdFree), writing the map if there were any
+void flushHeldFrees() {
+    pthread_mutex_lock(&bit_map_lock);
+    for(int i = 0; i < held_free_count; i++) {
+        if(held_frees[i] >= 0) freeDataBlock(held_frees[i] - 1 - super_block.inode_table_length);
+        else free_bit(-1 - held_frees[i], true);
+    }
+    if(held_free_count > 0) writeFreeBitMap();
+    held_free_count = 0;
+    pthread_mutex_unlock(&bit_map_lock);
 }
 
 // Method to find the number of files being used in the system
 int find_number_files() {
     // Loop over inodes list and count the number of 1s (free spaces)
     int sum = 0;
+    pthread_mutex_lock(&bit_map_lock);
     for(int i = 0; i < inode_num_bytes; i++) {
             unsigned char byt = free_bit_map[i];
             while (byt != 0) {
@@ -141,6 +297,7 @@ int find_number_files() {
                 byt = byt & (byt - 1);
         }
     }
+    pthread_mutex_unlock(&bit_map_lock);
 
     // total files possible - spaces open
     return super_block.inode_table_length - sum;
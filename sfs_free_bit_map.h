@@ -1,10 +1,16 @@
 #ifndef SFS_FREE_BIT_MAP_H
 #define SFS_FREE_BIT_MAP_H
-#include "sfs_super_block.h"
+#include "sfs_instance.h" // super_block & INODES_PER_BLOCK of the file system the calling thread uses
+#include <stdbool.h>
 
-extern SuperBlock super_block;
-extern int INODES_PER_BLOCK;
+// Make an empty map for a new file system (NULL if out of memory), or free the map of one being unmounted
+FreeBitMap* newFreeBitMap();
+void freeFreeBitMap(FreeBitMap* map);
 
+// Number of data blocks a file system of the given geometry has (after its iNode table, reference counts & map)
+int dataBlockCount(const SuperBlock* geometry);
+
+// Create or load the map. Not thread safe (the file system is being set up), the other calls are
 void createFreeBitMap();
 void loadFreeBitMap();
 
@@ -14,9 +20,15 @@ int grab_data_bit();
 // iNode grab returns open node index in iNode table position (first iNode = 0)
 int grab_inode_bit();
 
-// Free data block at block_index (in global disk position)
+// Free data block at block_index (in global disk position). A block shared by cloned files only loses a reference
 void free_data_bit(int block_index);
 
+// Add a reference to the data block at block_index (a clone shares it). Returns false if it can't hold more
+bool share_data_bit(int block_index);
+
+// Whether the data block at block_index is shared (must be copied before it is written)
+bool data_bit_shared(int block_index);
+
 // Free iNode index (in iNode position | first iNode = 0)
 void free_inode_bit(int inode_index);
 
@@ -24,7 +36,13 @@ void free_inode_bit(int inode_index);
 int find_number_files();
 
 
+// Write the map to disk (only marked dirty while saves are held, see holdSaves)
 void saveFreeBitMapToDisk();
+
+// Write the map if it was saved while saves were held. Blocks and iNodes freed while saves were held stay in use
+// (in memory and on disk) until flushHeldFrees, called once the iNodes that referred to them are written
+void flushFreeBitMap();
+void flushHeldFrees();
 //void readFreeBitMapFromDisk(); // Won't make that one public
 
 #endif
\ No newline at end of file
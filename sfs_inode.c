@@ -4,100 +4,496 @@
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#include <pthread.h>
+
+
+// iNode table block cache (write through, or write back while saves are held), so iNodes close together on disk
+// are read with one block read. Fixed size, the least recently used block gets replaced
+#define INODE_CACHE_BLOCKS 32
+
+typedef struct INodeCacheEntry {
+    int block;              // iNode table block held (-1 if unused)
+    unsigned int last_used; // Value of inode_cache_clock at last use
+    iNode* nodes;           // The block's iNodes (INODES_PER_BLOCK of them)
+    bool dirty;             // Changed while saves were held, not written yet
+} INodeCacheEntry;
+
+// Reader/writer locks of threads doing I/O on open files, picked by iNode index. A fixed array rather than one
+// per in-core iNode since fdt.nodes moves when it grows, so unrelated files only rarely share one
+#define INODE_LOCK_STRIPES 64
+
+// The caches and locks of one file system, used through the names below (those of the calling thread's file system)
+struct INodeCaches {
+    INodeCacheEntry inode_cache[INODE_CACHE_BLOCKS];
+    char* inode_cache_data; // Memory of every cached block
+    unsigned int inode_cache_clock;
+    pthread_mutex_t inode_cache_lock; // Held while using the cache
+    pthread_rwlock_t inode_locks[INODE_LOCK_STRIPES];
+
+    // Only one thread frees orphans at a time (each would free the same list head)
+    pthread_mutex_t orphan_lock;
+};
+
+INodeCaches* newINodeCaches() {
+    INodeCaches* caches = calloc(1, sizeof(INodeCaches));
+    if(caches == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate iNode cache memory!\n");
+        return NULL;
+    }
+    for(int i = 0; i < INODE_CACHE_BLOCKS; i++) caches->inode_cache[i].block = -1;
+    pthread_mutex_init(&caches->inode_cache_lock, NULL);
+    for(int i = 0; i < INODE_LOCK_STRIPES; i++) pthread_rwlock_init(caches->inode_locks + i, NULL);
+    pthread_mutex_init(&caches->orphan_lock, NULL);
+    return caches;
+}
 
+void freeINodeCaches(INodeCaches* caches) {
+    if(caches == NULL) return;
+    free(caches->inode_cache_data);
+    pthread_mutex_destroy(&caches->inode_cache_lock);
+    for(int i = 0; i < INODE_LOCK_STRIPES; i++) pthread_rwlock_destroy(caches->inode_locks + i);
+    pthread_mutex_destroy(&caches->orphan_lock);
+    free(caches);
+}
 
-// Private helper method to add an entry to the table - returns the index
-static int addFDTEntry(iNode node, int inode_idx) {
-    // Find an open fdt slot
-    int fdt_index = -1;
-    for(int i = 0; i < fdt.allocated; i++) {
-        if(fdt.table[i].inode_idx < 0) { 
-            fdt_index = i;
-            break;
+#define inode_cache (cur_fs->inode_caches->inode_cache)
+#define inode_cache_data (cur_fs->inode_caches->inode_cache_data)
+#define inode_cache_clock (cur_fs->inode_caches->inode_cache_clock)
+#define inode_cache_lock (cur_fs->inode_caches->inode_cache_lock)
+#define inode_locks (cur_fs->inode_caches->inode_locks)
+#define orphan_lock (cur_fs->inode_caches->orphan_lock)
+
+// Most blocks copyDataAt holds in memory at once, whatever the size of the copy
+#define COPY_BUFFER_BLOCKS 64
+
+// Orphans freed at once when the disk or iNodes run out, so a write pays for a few removed files, not all of them
+#define RECLAIM_BATCH 16
+
+
+// Helper - home slot of an iNode index in fdt.inode_map (multiplicative hash, map_size is a power of 2)
+static int inodeMapHome(int inode_idx) {
+    return (int) (((unsigned int) inode_idx * 2654435761u) & (unsigned int) (fdt.map_size - 1));
+}
+
+// Helper - slot of fdt.inode_map holding the iNode index, or the empty slot it would go in (linear probing)
+static int inodeMapSlot(int inode_idx) {
+    int slot = inodeMapHome(inode_idx);
+    while(fdt.inode_map[slot] >= 0 && fdt.nodes[fdt.inode_map[slot]].inode_idx != inode_idx) {
+        slot = (slot + 1) & (fdt.map_size - 1);
+    }
+    return slot;
+}
+
+// Helper - take the iNode index out of fdt.inode_map, shifting later entries back so probes stay unbroken
+static void inodeMapRemove(int inode_idx) {
+    int mask = fdt.map_size - 1;
+    int hole = inodeMapSlot(inode_idx);
+    if(fdt.inode_map[hole] < 0) return;
+    for(int next = (hole + 1) & mask; fdt.inode_map[next] >= 0; next = (next + 1) & mask) {
+        int home = inodeMapHome(fdt.nodes[fdt.inode_map[next]].inode_idx);
+        // Entry can fill the hole if the hole is between its home and where it sits
+        if(((next - home) & mask) >= ((next - hole) & mask)) {
+            fdt.inode_map[hole] = fdt.inode_map[next];
+            hole = next;
         }
     }
+    fdt.inode_map[hole] = -1;
+}
 
-    // No slot found
-    if(fdt_index < 0) {
-        fdt.allocated += 3;
-
-        iNode* new_inodes = realloc(fdt.inodes, fdt.allocated * sizeof(iNode));
-        FDTEntry* new_fdt = realloc(fdt.table, fdt.allocated * sizeof(FDTEntry));
-        if(new_inodes == NULL || new_fdt == NULL) {
-            fprintf(stderr, "ERROR: Unable to allocate File Descriptor Table cache memory!\n");
-            return -1;
-        }  else {
-            fdt.inodes = new_inodes;
-            fdt.table = new_fdt;
-                // I went for manually, we created 3 new entries
-            fdt.table[fdt.allocated - 3].inode_idx = -1;
-            fdt.table[fdt.allocated - 2].inode_idx = -1;
-            fdt.table[fdt.allocated - 1].inode_idx = -1;
-            fdt_index = fdt.size;
+// Empty the iNode table block cache (new or reloaded file system)
+void resetINodeCache() {
+    free(inode_cache_data);
+    inode_cache_data = NULL;
+    for(int i = 0; i < INODE_CACHE_BLOCKS; i++) {
+        inode_cache[i].block = -1;
+        inode_cache[i].dirty = false;
+    }
+    inode_cache_clock = 0;
+}
+
+// Helper - the lock of an iNode
+static pthread_rwlock_t* iNodeLock(int inode_idx) {
+    return inode_locks + inode_idx % INODE_LOCK_STRIPES;
+}
+
+// Helper - the lock of an fdt entry's iNode
+static pthread_rwlock_t* fdtNodeLock(int fdt_index) {
+    return iNodeLock(fdt.table[fdt_index].inode_idx);
+}
+
+// Lock the iNode of an fdt entry, shared (reading) or exclusive (writing or moving the entry's pointers)
+void lockFDTNode(int fdt_index, bool exclusive) {
+    if(exclusive) pthread_rwlock_wrlock(fdtNodeLock(fdt_index));
+    else pthread_rwlock_rdlock(fdtNodeLock(fdt_index));
+}
+
+void unlockFDTNode(int fdt_index) {
+    pthread_rwlock_unlock(fdtNodeLock(fdt_index));
+}
+
+// Lock the iNodes of two fdt entries (exclusive) for a copy between them. Always in lock order, so two
+// copies going opposite ways can't deadlock, and once if they share a lock
+void lockFDTNodePair(int fdt_a, int fdt_b) {
+    pthread_rwlock_t* a = fdtNodeLock(fdt_a);
+    pthread_rwlock_t* b = fdtNodeLock(fdt_b);
+    if(b < a) {
+        pthread_rwlock_t* first = b;
+        b = a;
+        a = first;
+    }
+    pthread_rwlock_wrlock(a);
+    if(b != a) pthread_rwlock_wrlock(b);
+}
+
+void unlockFDTNodePair(int fdt_a, int fdt_b) {
+    pthread_rwlock_t* a = fdtNodeLock(fdt_a);
+    pthread_rwlock_t* b = fdtNodeLock(fdt_b);
+    pthread_rwlock_unlock(a);
+    if(b != a) pthread_rwlock_unlock(b);
+}
+
+// Helper - cache entry holding the iNode table block, or the entry to replace with it (unused or least recently used)
+static INodeCacheEntry* inodeCacheEntry(int block_location) {
+    INodeCacheEntry* victim = inode_cache;
+    for(int i = 0; i < INODE_CACHE_BLOCKS; i++) {
+        INodeCacheEntry* entry = inode_cache + i;
+        if(entry->block == block_location) return entry;
+        if(victim->block >= 0 && (entry->block < 0 || entry->last_used < victim->last_used)) victim = entry;
+    }
+    return victim;
+}
+
+// Helper - give the cache entry victim to the iNode table block (contents not loaded yet). A dirty victim is written first
+static void claimCacheEntry(INodeCacheEntry* victim, int block_location) {
+    if(inode_cache_data == NULL) {
+        inode_cache_data = malloc((size_t) INODE_CACHE_BLOCKS * super_block.block_size);
+        for(int i = 0; i < INODE_CACHE_BLOCKS; i++) {
+            inode_cache[i].nodes = (iNode*) (inode_cache_data + (size_t) i * super_block.block_size);
+        }
+    }
+    if(victim->dirty) {
+        write_blocks(1 + victim->block, 1, victim->nodes); // +1 to pass super block
+        victim->dirty = false;
+    }
+    victim->block = block_location;
+    victim->last_used = ++inode_cache_clock;
+}
+
+// Helper - the iNodes of an iNode table block (read from disk if not cached). Valid until the next cache call,
+// changes must be written back with saveINodeBlock
+static iNode* iNodeBlock(int block_location) {
+    INodeCacheEntry* entry = inodeCacheEntry(block_location);
+    if(entry->block == block_location) {
+        entry->last_used = ++inode_cache_clock;
+        return entry->nodes;
+    }
+    claimCacheEntry(entry, block_location);
+    read_blocks(1 + block_location, 1, entry->nodes); // +1 to pass super block
+    return entry->nodes;
+}
+
+static int compareInts(const void* a, const void* b) {
+    return *(const int*) a - *(const int*) b;
+}
+
+// Helper - write back the (cached) iNode table block after changes, or only mark it dirty while saves are held.
+// inode_cache_lock held
+static void saveINodeBlock(int block_location) {
+    INodeCacheEntry* entry = inodeCacheEntry(block_location);
+    if(cur_fs->saves_held > 0) entry->dirty = true;
+    else write_blocks(1 + block_location, 1, entry->nodes); // +1 to pass super block
+}
+
+// Helper - write the iNode table blocks changed while saves were held, each run of consecutive blocks with one disk write
+static void flushINodeCache() {
+    pthread_mutex_lock(&inode_cache_lock);
+    int blocks[INODE_CACHE_BLOCKS];
+    int dirty = 0;
+    for(int i = 0; i < INODE_CACHE_BLOCKS; i++) {
+        if(inode_cache[i].dirty) blocks[dirty++] = inode_cache[i].block;
+    }
+    qsort(blocks, dirty, sizeof(int), compareInts);
+
+    char* buffer = (dirty > 0) ? malloc((size_t) dirty * super_block.block_size) : NULL;
+    for(int start = 0; start < dirty;) {
+        int run = 0;
+        do {
+            INodeCacheEntry* entry = inodeCacheEntry(blocks[start + run]);
+            memcpy(buffer + (size_t) run * super_block.block_size, entry->nodes, super_block.block_size);
+            entry->dirty = false;
+            run++;
+        } while(start + run < dirty && blocks[start + run] == blocks[start] + run);
+        write_blocks(1 + blocks[start], run, buffer); // +1 to pass super block
+        start += run;
+    }
+    pthread_mutex_unlock(&inode_cache_lock);
+    free(buffer);
+}
+
+// Keep iNode table, free bit map and super block changes in memory (marked dirty) until flushSaves or releaseSaves,
+// so a run of calls writes each changed block once. Holds nest
+void holdSaves() {
+    cur_fs->saves_held++;
+}
+
+// Write what changed while saves are held, and keep holding. In the order the calls save in: the bit map (blocks
+// and iNodes taken, before the iNodes using them), the iNodes, the super block (orphans are on disk before it lists
+// them), then what was freed (once nothing on disk refers to it)
+void flushSaves() {
+    if(cur_fs->saves_held == 0) return;
+    flushFreeBitMap();
+    flushINodeCache();
+    flushSuperBlock();
+    flushHeldFrees();
+}
+
+// End a holdSaves. The last one writes what changed (as flushSaves)
+void releaseSaves() {
+    if(cur_fs->saves_held == 1) flushSaves();
+    cur_fs->saves_held--;
+}
+
+// Load the iNode table blocks holding the given iNodes into the iNode cache. Missing blocks are read in 
+// table order, each run of consecutive blocks with one disk read (at most a cache full)
+void prefetchINodes(const int* inode_indices, int count) {
+    int* blocks = malloc(count * sizeof(int));
+    int missing = 0;
+    pthread_mutex_lock(&inode_cache_lock);
+    for(int i = 0; i < count; i++) {
+        int block_location = inode_indices[i] / INODES_PER_BLOCK;
+        if(inodeCacheEntry(block_location)->block != block_location) blocks[missing++] = block_location;
+    }
+    qsort(blocks, missing, sizeof(int), compareInts);
+
+    // Distinct blocks only, and no more than fit
+    int distinct = 0;
+    for(int i = 0; i < missing && distinct < INODE_CACHE_BLOCKS; i++) {
+        if(distinct == 0 || blocks[distinct - 1] != blocks[i]) blocks[distinct++] = blocks[i];
+    }
+
+    char* buffer = malloc((size_t) INODE_CACHE_BLOCKS * super_block.block_size);
+    for(int start = 0; start < distinct;) {
+        int run = 1;
+        while(start + run < distinct && blocks[start + run] == blocks[start] + run) run++;
+        read_blocks(1 + blocks[start], run, buffer); // +1 to pass super block
+        for(int i = 0; i < run; i++) {
+            INodeCacheEntry* entry = inodeCacheEntry(blocks[start + i]);
+            claimCacheEntry(entry, blocks[start + i]);
+            memcpy(entry->nodes, buffer + (size_t) i * super_block.block_size, super_block.block_size);
         }
+        start += run;
+    }
+    pthread_mutex_unlock(&inode_cache_lock);
+    free(buffer);
+    free(blocks);
+}
+
+// Helper - double the handle table (existing fdt indices don't change). Returns success
+static bool growFDT() {
+    int new_allocated = (fdt.allocated == 0) ? 4 : fdt.allocated * 2;
+
+    FDTEntry* new_fdt = realloc(fdt.table, new_allocated * sizeof(FDTEntry));
+    if(new_fdt != NULL) fdt.table = new_fdt;
+    int* new_free = realloc(fdt.free_slots, new_allocated * sizeof(int));
+    if(new_free != NULL) fdt.free_slots = new_free;
+    if(new_fdt == NULL || new_free == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate File Descriptor Table cache memory!\n");
+        return false;
+    }
+
+    // New entries are free - pushed so lower indices get used first
+    for(int i = new_allocated - 1; i >= fdt.allocated; i--) {
+        fdt.table[i].inode_idx = -1;
+        fdt.free_slots[fdt.free_count++] = i;
     }
+    fdt.allocated = new_allocated;
+    return true;
+}
+
+// Helper - double the in-core iNode table (existing slots don't change) and rebuild the iNode map. Returns success
+static bool growNodes() {
+    int new_allocated = (fdt.nodes_allocated == 0) ? 4 : fdt.nodes_allocated * 2;
+
+    InCoreNode* new_nodes = realloc(fdt.nodes, new_allocated * sizeof(InCoreNode));
+    if(new_nodes != NULL) fdt.nodes = new_nodes;
+    int* new_free = realloc(fdt.free_nodes, new_allocated * sizeof(int));
+    if(new_free != NULL) fdt.free_nodes = new_free;
+    int* new_map = malloc(2 * new_allocated * sizeof(int)); // Keep map at most half full
+    if(new_nodes == NULL || new_free == NULL || new_map == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate iNode cache memory!\n");
+        free(new_map);
+        return false;
+    }
+
+    for(int i = new_allocated - 1; i >= fdt.nodes_allocated; i--) {
+        fdt.nodes[i].inode_idx = -1;
+        fdt.free_nodes[fdt.free_node_count++] = i;
+    }
+    int old_allocated = fdt.nodes_allocated;
+    fdt.nodes_allocated = new_allocated;
+
+    free(fdt.inode_map);
+    fdt.inode_map = new_map;
+    fdt.map_size = 2 * new_allocated;
+    for(int i = 0; i < fdt.map_size; i++) fdt.inode_map[i] = -1;
+    for(int i = 0; i < old_allocated; i++) {
+        if(fdt.nodes[i].inode_idx >= 0) fdt.inode_map[inodeMapSlot(fdt.nodes[i].inode_idx)] = i;
+    }
+    return true;
+}
+
+// Private helper method to add an in-core iNode - returns the node slot
+static int addInCoreNode(iNode node, int inode_idx) {
+    if(fdt.free_node_count == 0 && !growNodes()) return -1;
+    int slot = fdt.free_nodes[--fdt.free_node_count];
+    fdt.nodes[slot] = (InCoreNode) {.node = node, .inode_idx = inode_idx, .ref_count = 0,
+                                    .tail_buffer = NULL, .tail_block = -1, .tail_disk_idx = -1, .tail_dirty = false};
+    fdt.inode_map[inodeMapSlot(inode_idx)] = slot;
+    fdt.node_count++;
+    return slot;
+}
+
+// Helper - drop an in-core iNode nobody uses anymore (does not save it)
+static void removeInCoreNode(int slot) {
+    free(fdt.nodes[slot].tail_buffer);
+    fdt.nodes[slot].tail_buffer = NULL;
+    inodeMapRemove(fdt.nodes[slot].inode_idx);
+    fdt.nodes[slot].inode_idx = -1;
+    fdt.free_nodes[fdt.free_node_count++] = slot;
+    fdt.node_count--;
+}
+
+// Private helper method to add a handle on an in-core iNode to the table - returns the index
+static int addFDTEntry(int slot) {
+    // Take a free fdt slot, growing the table if there are none
+    if(fdt.free_count == 0 && !growFDT()) return -1;
+    int fdt_index = fdt.free_slots[--fdt.free_count];
+
     // Set values
-    fdt.inodes[fdt_index] = node;
-    fdt.table[fdt_index] = (FDTEntry) {.inode_idx = inode_idx, .readPointer = 0, .writePointer = node.size};
+    fdt.table[fdt_index] = (FDTEntry) {.inode_idx = fdt.nodes[slot].inode_idx, .node_slot = slot,
+                                       .readPointer = 0, .writePointer = fdt.nodes[slot].node.size};
+    fdt.nodes[slot].ref_count++;
     fdt.size++;
     return fdt_index;
 }
 
-// Helper - saves the iNode of the given fdt entry back to disk
-static void saveFDTNode(int fdt_index) {
-    int block_location  = fdt.table[fdt_index].inode_idx / INODES_PER_BLOCK;
-    int local_block_loc = fdt.table[fdt_index].inode_idx % INODES_PER_BLOCK;
+// Helper - free the fdt index (does not touch the in-core iNode)
+static void removeFDTEntry(int fdt_index) {
+    fdt.table[fdt_index].inode_idx = -1;
+    fdt.free_slots[fdt.free_count++] = fdt_index;
+    fdt.size--;
+}
 
-    iNode* node_list = malloc(super_block.block_size);
-    read_blocks(1 + block_location, 1, node_list); // +1 to pass super block
-    node_list[local_block_loc] = fdt.inodes[fdt_index];
-    write_blocks(1 + block_location, 1, node_list);
-    free(node_list);
+// Helper - saves the in-core iNode back to disk
+static void saveNode(int slot) {
+    int block_location  = fdt.nodes[slot].inode_idx / INODES_PER_BLOCK;
+    int local_block_loc = fdt.nodes[slot].inode_idx % INODES_PER_BLOCK;
+
+    pthread_mutex_lock(&inode_cache_lock);
+    iNode* node_list = iNodeBlock(block_location);
+    node_list[local_block_loc] = fdt.nodes[slot].node;
+    saveINodeBlock(block_location);
+    pthread_mutex_unlock(&inode_cache_lock);
 }
 
-// Load (or find) an inode from disk into the file descriptor table - returns FDT index
-int openFDTNode(int inode_index) {
-    // First check if we already have it in the fdt - avoid re-opening
-    int fdt_index = -1;
-    for(int i = 0; i < fdt.allocated; i++) {
-        if(fdt.table[i].inode_idx == inode_index) {
-            return i;
-        }
+// Saves the iNode of the given fdt entry back to disk
+void saveFDTNode(int fdt_index) {
+    saveNode(fdt.table[fdt_index].node_slot);
+}
+
+// Helper - write any buffered tail block (and the iNode it changed) of the in-core iNode to disk
+static void flushNode(int slot) {
+    InCoreNode* in_core = fdt.nodes + slot;
+    if(in_core->tail_dirty) {
+        write_blocks(in_core->tail_disk_idx, 1, in_core->tail_buffer);
+        saveNode(slot);
+        in_core->tail_dirty = false;
+    }
+    in_core->tail_block = -1;
+}
+
+// Write any buffered tail block (and the iNode it changed) to disk. The tail is dropped afterwards,
+// so other writers can change the block on disk without leaving a stale copy behind
+void flushFDTNode(int fdt_index) {
+    flushNode(fdt.table[fdt_index].node_slot);
+}
+
+// Helper - take a free data block, freeing the space of removed files (orphans) a batch at a time while there is
+// none left. Returns the block (global disk position), or -1 if the disk is full
+static int grabDataBlock() {
+    int block = grab_data_bit();
+    while(block < 0) {
+        int reclaimed = reclaimOrphans(RECLAIM_BATCH);
+        flushSaves(); // Frees held back by a batch only reach the map once flushed
+        block = grab_data_bit(); // Even with none left, another thread may have just freed some
+        if(reclaimed == 0) break;
     }
+    return block;
+}
+
+// Helper - in-core node slot of the iNode, or -1 if it is not in-core
+static int inCoreSlot(int inode_index) {
+    return (fdt.map_size > 0) ? fdt.inode_map[inodeMapSlot(inode_index)] : -1;
+}
+
+// Open a new handle on an inode (loading it from disk if not already in-core) - returns FDT index
+int openFDTNode(int inode_index) {
+    // First check if we already have the iNode in-core - avoid re-reading
+    int slot = inCoreSlot(inode_index);
 
     // Read node from disk
-    int block_location  = inode_index / INODES_PER_BLOCK;
-    int local_block_loc = inode_index % INODES_PER_BLOCK;
-    iNode* node_list = (iNode*) malloc(super_block.block_size);
-    read_blocks(block_location + 1, 1, node_list); //+1 to pass super block
-    fdt_index = addFDTEntry(node_list[local_block_loc], inode_index);
-    free(node_list);
-    
+    if(slot < 0) {
+        int block_location  = inode_index / INODES_PER_BLOCK;
+        int local_block_loc = inode_index % INODES_PER_BLOCK;
+        pthread_mutex_lock(&inode_cache_lock);
+        iNode node = iNodeBlock(block_location)[local_block_loc];
+        pthread_mutex_unlock(&inode_cache_lock);
+        slot = addInCoreNode(node, inode_index);
+        if(slot < 0) return -1;
+    }
+
+    int fdt_index = addFDTEntry(slot);
+    if(fdt_index < 0 && fdt.nodes[slot].ref_count == 0) removeInCoreNode(slot);
     return fdt_index;
 }
 
-// DOES NOT SAVE - saving should be done continuously over program
-void closeFDTNode(int fdt_index) {
-    fdt.size--;
-    fdt.table[fdt_index].inode_idx = -1;
+static int compareInodes(const void* a, const void* b) {
+    return **(const int* const*) a - **(const int* const*) b;
+}
 
-    // Seeing if we can repackage (close up some mem) on FDT
-    int last_index = fdt.allocated - 1;
-    for(; last_index >= fdt.size; last_index--) {
-        if(fdt.table[last_index].inode_idx >= 0) break; // Break on first uncleared FDT entry
-    }
-    int dec_count = (fdt.allocated-1 - last_index) / 3; // Number of free spaces (in chunks of 3)
-    if (dec_count > 0 ) {
-        fdt.allocated -= 3*dec_count;
-        iNode* new_inodes = realloc(fdt.inodes, fdt.allocated * sizeof(iNode));
-        FDTEntry* new_fdt = realloc(fdt.table, fdt.allocated * sizeof(FDTEntry));
-        if(new_inodes == NULL || new_fdt == NULL) {
-            fprintf(stderr, "ERROR: Unable to deallocate iNode cache memory!\n");
-        } else {
-            fdt.inodes = new_inodes;
-            fdt.table = new_fdt;
+// Copy the iNodes with the given indices into nodes (same order). In-core iNodes are copied from memory,
+// the rest are read (through the iNode cache) in iNode table order so each table block is read once
+void readINodes(const int* inode_indices, int count, iNode* nodes) {
+    const int** order = malloc(count * sizeof(int*));
+    for(int i = 0; i < count; i++) order[i] = inode_indices + i;
+    qsort(order, count, sizeof(int*), compareInodes);
+
+    for(int i = 0; i < count; i++) {
+        int inode_index = *order[i];
+        iNode* node = nodes + (order[i] - inode_indices);
+        int slot = inCoreSlot(inode_index);
+        if(slot >= 0) {
+            // Open files may be written with fs_lock shared, under their iNode lock
+            pthread_rwlock_rdlock(iNodeLock(inode_index));
+            *node = fdt.nodes[slot].node;
+            pthread_rwlock_unlock(iNodeLock(inode_index));
+            continue;
         }
+        pthread_mutex_lock(&inode_cache_lock);
+        *node = iNodeBlock(inode_index / INODES_PER_BLOCK)[inode_index % INODES_PER_BLOCK];
+        pthread_mutex_unlock(&inode_cache_lock);
     }
+    free(order);
+}
+
+// Closes the handle. The last handle on an iNode only saves buffered appends - other saving
+// should be done continuously over program
+void closeFDTNode(int fdt_index) {
+    int slot = fdt.table[fdt_index].node_slot;
+    removeFDTEntry(fdt_index);
+    if(--fdt.nodes[slot].ref_count > 0) return;
+    flushNode(slot);
+    removeInCoreNode(slot);
 }
 
 // Massive helper method - fill the int buffer w/ block location of the given node's data blocks
@@ -115,7 +511,7 @@ static int getNodeDataBlockList(iNode* node, int start_block, int last_block, in
         // Need to grab a new data block
         if(cur >= node->blocks_allocated) {
             if(i < num_existing) num_existing = i;
-            disk_data_idxs[i] = grab_data_bit();
+            disk_data_idxs[i] = grabDataBlock();
             if(disk_data_idxs[i] < 0) break;
             if(cur < 12) {
                 node->direct_pointer[cur] = disk_data_idxs[i];
@@ -124,7 +520,7 @@ static int getNodeDataBlockList(iNode* node, int start_block, int last_block, in
                     i_buff = malloc(super_block.block_size);
                     // Create indirect pointer or load existing to buffer
                     if(cur == 12) {
-                        node->indirect_pointer = grab_data_bit();
+                        node->indirect_pointer = grabDataBlock();
                         if(node->indirect_pointer < 0) break;
                     } else read_blocks(node->indirect_pointer, 1, i_buff);
                     first_i = false;
@@ -141,7 +537,7 @@ static int getNodeDataBlockList(iNode* node, int start_block, int last_block, in
                     di_buff[0] = malloc(super_block.block_size);
                     // Either create the level 1 block or read it
                     if(level_1 == 0 && level_2 == 0) {
-                        node->double_indirect_pointer = grab_data_bit();
+                        node->double_indirect_pointer = grabDataBlock();
                         if(node->double_indirect_pointer < 0) break;
                     } else read_blocks(node->double_indirect_pointer, 1, di_buff[0]);
                     first_di[0] = false;
@@ -157,7 +553,7 @@ static int getNodeDataBlockList(iNode* node, int start_block, int last_block, in
                     }
                     // Either create level 2 (indirect) block or read it
                     if(level_2 == 0) {
-                        di_buff[0][level_1] = grab_data_bit(); 
+                        di_buff[0][level_1] = grabDataBlock(); 
                         if(di_buff[0][level_1] < 0) break;
                         wrote_di_level[0] = true; // Updated the level 1 block
                     } else read_blocks(di_buff[0][level_1], 1, di_buff[1]);
@@ -202,8 +598,8 @@ static int getNodeDataBlockList(iNode* node, int start_block, int last_block, in
         }
     }
 
-    // If we wrote new data blocks
-    if(cur >= node->blocks_allocated) {
+    // If we wrote new data blocks (a lookup of existing ones writes nothing, readers may share the iNode)
+    if(num_existing != INT_MAX) {
         if(!first_i) write_blocks(node->indirect_pointer, 1, i_buff); 
         if(wrote_di_level[0]) write_blocks(node->double_indirect_pointer, 1, di_buff[0]);
         if(wrote_di_level[1]) write_blocks(di_buff[0][last_di_level_1], 1, di_buff[1]);
@@ -227,79 +623,516 @@ static int getNodeDataBlockList(iNode* node, int start_block, int last_block, in
     return num_existing;
 }
 
+// Helper - point the count data blocks of node from file block first_block (all allocated already) at the given
+// disk blocks. Each indirect block involved is read and written once
+static void setNodeDataBlocks(iNode* node, int first_block, const int* disk_data_idxs, int count) {
+    int* i_buff = NULL;
+    int* di_buff[2] = {NULL, NULL};
+    int level_2_block = -1; // Disk block of the indirect block held in di_buff[1]
+
+    for(int i = 0, cur = first_block; i < count; i++, cur++) {
+        if(cur < 12) {
+            node->direct_pointer[cur] = disk_data_idxs[i];
+        } else if(cur < 12 + POINTERS_PER_BLOCK) {
+            if(i_buff == NULL) {
+                i_buff = malloc(super_block.block_size);
+                read_blocks(node->indirect_pointer, 1, i_buff);
+            }
+            i_buff[cur - 12] = disk_data_idxs[i];
+        } else {
+            int level_1 = cur - 12 - POINTERS_PER_BLOCK;
+            int level_2 = level_1 % POINTERS_PER_BLOCK;
+            level_1 = level_1 / POINTERS_PER_BLOCK;
+            if(di_buff[0] == NULL) {
+                di_buff[0] = malloc(super_block.block_size);
+                di_buff[1] = malloc(super_block.block_size);
+                read_blocks(node->double_indirect_pointer, 1, di_buff[0]);
+            }
+            if(di_buff[0][level_1] != level_2_block) {
+                if(level_2_block >= 0) write_blocks(level_2_block, 1, di_buff[1]);
+                level_2_block = di_buff[0][level_1];
+                read_blocks(level_2_block, 1, di_buff[1]);
+            }
+            di_buff[1][level_2] = disk_data_idxs[i];
+        }
+    }
+
+    if(i_buff != NULL) write_blocks(node->indirect_pointer, 1, i_buff);
+    if(level_2_block >= 0) write_blocks(level_2_block, 1, di_buff[1]);
+    free(i_buff);
+    free(di_buff[0]);
+    free(di_buff[1]);
+}
+
+// Helper - before writing them, give node its own copy of every shared (cloned) block among its count data blocks
+// from file block first_block. disk_data_idxs holds their disk blocks, and is switched to the copies.
+// Only the first and last blocks (if copy_first / copy_last) keep their data, the caller overwrites the rest whole.
+// Returns false, with nothing changed, if the disk is full
+static bool unshareBlocks(iNode* node, int first_block, int* disk_data_idxs, int count, bool copy_first, bool copy_last) {
+    int shared = 0;
+    for(int i = 0; i < count; i++) {
+        if(data_bit_shared(disk_data_idxs[i])) shared++;
+    }
+    if(shared == 0) return true;
+
+    int* fresh = malloc(shared * sizeof(int));
+    if(fresh == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate block list memory!\n");
+        return false;
+    }
+    int grabbed = 0;
+    while(grabbed < shared && (fresh[grabbed] = grabDataBlock()) >= 0) grabbed++;
+    if(grabbed < shared) {
+        for(int i = 0; i < grabbed; i++) free_data_bit(fresh[i]);
+        free(fresh);
+        return false;
+    }
 
-// Will place the iNode within the open file descriptor table
-int createINode(bool is_directory) {
-    // Allocate new inode block
-    int idx = grab_inode_bit();
-    if(idx < 0) return idx;
+    char* block_buffer = NULL;
+    int used = 0;
+    for(int i = 0; i < count; i++) {
+        // Grabbing may have freed removed clones, so a block counted shared above may not be anymore
+        if(!data_bit_shared(disk_data_idxs[i])) continue;
+        if((i == 0 && copy_first) || (i == count - 1 && copy_last)) {
+            if(block_buffer == NULL) block_buffer = malloc(super_block.block_size);
+            read_blocks(disk_data_idxs[i], 1, block_buffer);
+            write_blocks(fresh[used], 1, block_buffer);
+        }
+        free_data_bit(disk_data_idxs[i]); // Drops this file's reference
+        disk_data_idxs[i] = fresh[used++];
+    }
+    for(int i = used; i < shared; i++) free_data_bit(fresh[i]);
+
+    setNodeDataBlocks(node, first_block, disk_data_idxs, count);
     saveFreeBitMapToDisk();
+    free(block_buffer);
+    free(fresh);
+    return true;
+}
 
 
-    int fdt_index = addFDTEntry((iNode) {0}, idx);
-    fdt.inodes[fdt_index].is_directory = is_directory;
-    fdt.inodes[fdt_index].file_id = ++MAX_FILE_ID;
-    // Still unused = link_count, uid, gid
-    saveFDTNode(fdt_index); // Save iNode block to disk
+static int compareInodeIdx(const void* a, const void* b) {
+    return fdt.table[*(const int*) a].inode_idx - fdt.table[*(const int*) b].inode_idx;
+}
+
+// Helper - save the iNodes of the given fdt entries to disk, reading and writing each iNode table block once
+static void saveFDTNodes(const int* fdt_indices, int count) {
+    int* order = malloc(count * sizeof(int));
+    memcpy(order, fdt_indices, count * sizeof(int));
+    qsort(order, count, sizeof(int), compareInodeIdx);
+
+    pthread_mutex_lock(&inode_cache_lock);
+    for(int i = 0; i < count;) {
+        int block_location = fdt.table[order[i]].inode_idx / INODES_PER_BLOCK;
+        iNode* node_list = iNodeBlock(block_location);
+        for(; i < count && fdt.table[order[i]].inode_idx / INODES_PER_BLOCK == block_location; i++) {
+            node_list[fdt.table[order[i]].inode_idx % INODES_PER_BLOCK] = *fdtNode(order[i]);
+        }
+        saveINodeBlock(block_location);
+    }
+    pthread_mutex_unlock(&inode_cache_lock);
+    free(order);
+}
+
+// Will place the iNode within the open file descriptor table
+int createINode(bool is_directory) {
+    int fdt_index;
+    if(createINodes(1, is_directory, &fdt_index) < 0) return -1;
     return fdt_index;
 }
 
+// Will place count iNodes within the open file descriptor table. The bitmap is saved once and
+// every iNode table block touched is written once. Nothing is created if they don't all fit
+int createINodes(int count, bool is_directory, int* fdt_indices) {
+    int created = 0;
+    for(; created < count; created++) {
+        // Allocate new inode
+        int idx = grab_inode_bit();
+        while(idx < 0) {
+            int reclaimed = reclaimOrphans(RECLAIM_BATCH); // Space of removed files
+            flushSaves();
+            idx = grab_inode_bit();
+            if(reclaimed == 0) break;
+        }
+        if(idx < 0) break;
+        int slot = addInCoreNode((iNode) {0}, idx);
+        int fdt_index = (slot < 0) ? -1 : addFDTEntry(slot);
+        if(fdt_index < 0) {
+            if(slot >= 0) removeInCoreNode(slot);
+            free_inode_bit(idx);
+            break;
+        }
+        fdtNode(fdt_index)->is_directory = is_directory;
+        fdtNode(fdt_index)->file_id = ++MAX_FILE_ID;
+        fdtNode(fdt_index)->link_count = 1; // The directory entry it is created for
+        // Still unused = uid, gid
+        fdt_indices[created] = fdt_index;
+    }
 
+    // Out of iNodes (or memory) - give back the ones already taken
+    if(created < count) {
+        for(int i = 0; i < created; i++) {
+            int slot = fdt.table[fdt_indices[i]].node_slot;
+            free_inode_bit(fdt.table[fdt_indices[i]].inode_idx);
+            removeFDTEntry(fdt_indices[i]);
+            removeInCoreNode(slot);
+        }
+        MAX_FILE_ID -= created;
+        return -1;
+    }
 
-// Returns deleted node
-FDTEntry deleteINode(int fdt_index) {
-    FDTEntry old = fdt.table[fdt_index];
-    iNode old_node = fdt.inodes[fdt_index];
+    saveFreeBitMapToDisk();
+    saveFDTNodes(fdt_indices, count); // Save iNode blocks to disk
+    return count;
+}
+
+
+// Create a new iNode holding the same data as the file at src_fdt. Its data blocks are shared (one more reference
+// each) rather than copied, only its indirect blocks are new. Returns the clone's fdt index, or -1 if the disk is full
+int cloneINode(int src_fdt) {
+    flushFDTNode(src_fdt); // Buffered tail goes to disk, and later appends see the block is shared
+    int blocks = fdtNode(src_fdt)->blocks_allocated;
+    int indirects = 0; // Blocks under the double indirect block
+    if(blocks > 12 + POINTERS_PER_BLOCK) {
+        indirects = (blocks - 12 - POINTERS_PER_BLOCK + POINTERS_PER_BLOCK - 1) / POINTERS_PER_BLOCK;
+    }
+    int pointer_blocks = (blocks > 12) + (indirects > 0) + indirects;
 
+    int* disk_data_idxs = malloc(sizeof(int) * (blocks + pointer_blocks + 1));
+    int* pointers = disk_data_idxs + blocks; // [indirect, double indirect, its indirects...]
+    char* block_buffer = malloc(super_block.block_size);
+    int fdt_index = (disk_data_idxs == NULL || block_buffer == NULL) ? -1 : createINode(false);
+    if(fdt_index < 0) {
+        free(disk_data_idxs);
+        free(block_buffer);
+        return -1;
+    }
+    if(blocks > 0) getNodeDataBlockList(fdtNode(src_fdt), 0, blocks - 1, disk_data_idxs);
+
+    // Take the clone's indirect blocks, then a reference on every data block
+    int taken = 0, shared = 0;
+    while(taken < pointer_blocks && (pointers[taken] = grabDataBlock()) >= 0) taken++;
+    for(; taken == pointer_blocks && shared < blocks; shared++) {
+        if(share_data_bit(disk_data_idxs[shared])) continue;
+        // Block has all the references it can hold, this one gets a copy
+        int copy = grabDataBlock();
+        if(copy < 0) break;
+        read_blocks(disk_data_idxs[shared], 1, block_buffer);
+        write_blocks(copy, 1, block_buffer);
+        disk_data_idxs[shared] = copy;
+    }
+    if(shared < blocks) {
+        for(int i = 0; i < shared; i++) free_data_bit(disk_data_idxs[i]);
+        for(int i = 0; i < taken; i++) free_data_bit(pointers[i]);
+        deleteINode(fdt_index); // Has no blocks yet, saves the bit map
+        free(disk_data_idxs);
+        free(block_buffer);
+        return -1;
+    }
+
+    // Fill the clone's pointers
+    iNode* node = fdtNode(fdt_index);
+    node->size = fdtNode(src_fdt)->size;
+    node->blocks_allocated = blocks;
+    for(int i = 0; i < blocks && i < 12; i++) node->direct_pointer[i] = disk_data_idxs[i];
+    int* pointer_buffer = (int*) block_buffer;
+    for(int i = 0; i < pointer_blocks; i++) {
+        // pointers[i] holds the data blocks from file block first (or the indirect blocks if the double indirect)
+        int first = (i == 0) ? 12 : 12 + POINTERS_PER_BLOCK * (i - 1);
+        int count = blocks - first;
+        memset(pointer_buffer, 0, super_block.block_size);
+        if(i == 1) {
+            memcpy(pointer_buffer, pointers + 2, indirects * sizeof(int));
+            node->double_indirect_pointer = pointers[1];
+        } else {
+            if(count > POINTERS_PER_BLOCK) count = POINTERS_PER_BLOCK;
+            memcpy(pointer_buffer, disk_data_idxs + first, count * sizeof(int));
+            if(i == 0) node->indirect_pointer = pointers[0];
+        }
+        write_blocks(pointers[i], 1, pointer_buffer);
+    }
+    saveFreeBitMapToDisk();
+    saveFDTNode(fdt_index);
+    free(disk_data_idxs);
+    free(block_buffer);
+    return fdt_index;
+}
+
+
+// Helper - free the data blocks (and indirect blocks) of the iNode in the bit map (not saved to disk)
+static void freeNodeBlocks(iNode* node) {
     // Loop through list of data block indices and free them in bit map
-    int* list_buffer = malloc(sizeof(int) * old_node.blocks_allocated);
-    getNodeDataBlockList(fdt.inodes + fdt_index, 0, old_node.blocks_allocated - 1, list_buffer);
-    for(int i = 0; i < old_node.blocks_allocated; i++) {
+    int* list_buffer = malloc(sizeof(int) * node->blocks_allocated);
+    getNodeDataBlockList(node, 0, node->blocks_allocated - 1, list_buffer);
+    for(int i = 0; i < node->blocks_allocated; i++) {
         free_data_bit(list_buffer[i]); 
     }
-    if(old_node.blocks_allocated > 12) free_data_bit(old_node.indirect_pointer);
-    if(old_node.blocks_allocated > 12 + POINTERS_PER_BLOCK) {
+    if(node->blocks_allocated > 12) free_data_bit(node->indirect_pointer);
+    if(node->blocks_allocated > 12 + POINTERS_PER_BLOCK) {
         // Have to free all indirects & the double indirect
         int* double_buffer = malloc(super_block.block_size);
-        read_blocks(old_node.double_indirect_pointer, 1, double_buffer);
+        read_blocks(node->double_indirect_pointer, 1, double_buffer);
 
-        int num_indirects = old_node.blocks_allocated - 12 - POINTERS_PER_BLOCK;
+        int num_indirects = node->blocks_allocated - 12 - POINTERS_PER_BLOCK;
         num_indirects = (num_indirects / POINTERS_PER_BLOCK) + 
                         (num_indirects % POINTERS_PER_BLOCK != 0); // Ceiling division
         for(int i = 0; i < num_indirects; i++) {
             free_data_bit(double_buffer[i]); 
         }
-        free_data_bit(old_node.double_indirect_pointer);
+        free_data_bit(node->double_indirect_pointer);
         free(double_buffer);
     }
     free(list_buffer);
+}
+
+// Helper - forget the in-core iNode at slot and every handle on it (the iNode is gone, nothing is saved)
+static void dropInCoreNode(int slot) {
+    // Buffered appends are going away with the file, don't write them
+    fdt.nodes[slot].tail_dirty = false;
+    fdt.nodes[slot].tail_block = -1;
+    for(int i = 0; i < fdt.allocated; i++) {
+        if(fdt.table[i].inode_idx >= 0 && fdt.table[i].node_slot == slot) removeFDTEntry(i);
+    }
+    removeInCoreNode(slot);
+}
+
+// Returns deleted node
+FDTEntry deleteINode(int fdt_index) {
+    int slot = fdt.table[fdt_index].node_slot;
+    FDTEntry old = fdt.table[fdt_index];
+    iNode old_node = fdt.nodes[slot].node;
+
+    freeNodeBlocks(&old_node);
     free_inode_bit(old.inode_idx);
     
     // Update cache bitmap changes back
     saveFreeBitMapToDisk();
 
-    // Update fdt
-    closeFDTNode(fdt_index);
-
+    dropInCoreNode(slot);
     return old;
 }
 
-// Write data into inode_e's iNode, overwriting based on write pointer
-long overwriteData(int fdt_index, const void* data_buffer, long data_size) {
-    char* data = (char*) data_buffer;
-    FDTEntry* fdt_e = fdt.table + fdt_index;
-    iNode* node = fdt.inodes + fdt_index;
+// Deletes the iNodes with the given indices (and their data) without opening them. The bit map is
+// saved once at the end, and iNodes that are not in-core are read in iNode table order
+void deleteINodes(const int* inode_indices, int count) {
+    int* order = malloc(count * sizeof(int));
+    memcpy(order, inode_indices, count * sizeof(int));
+    qsort(order, count, sizeof(int), compareInts);
+
+    for(int i = 0; i < count; i++) {
+        if(i > 0 && order[i] == order[i - 1]) continue; // Listed twice
+        int slot = inCoreSlot(order[i]);
+        pthread_mutex_lock(&inode_cache_lock);
+        iNode node = (slot >= 0) ? fdt.nodes[slot].node : iNodeBlock(order[i] / INODES_PER_BLOCK)[order[i] % INODES_PER_BLOCK];
+        pthread_mutex_unlock(&inode_cache_lock);
+        freeNodeBlocks(&node);
+        free_inode_bit(order[i]);
+        if(slot >= 0) dropInCoreNode(slot);
+    }
+    saveFreeBitMapToDisk();
+    free(order);
+}
+
+// Put the iNodes with the given indices on the orphan list (kept on disk, head in the super block) instead
+// of deleting them. Their handles are dropped, and each iNode table block is written once
+void orphanINodes(const int* inode_indices, int count) {
+    int* order = malloc(count * sizeof(int));
+    memcpy(order, inode_indices, count * sizeof(int));
+    qsort(order, count, sizeof(int), compareInts);
+
+    pthread_mutex_lock(&inode_cache_lock);
+    for(int i = 0; i < count;) {
+        int block_location = order[i] / INODES_PER_BLOCK;
+        iNode* node_list = iNodeBlock(block_location);
+        for(; i < count && order[i] / INODES_PER_BLOCK == block_location; i++) {
+            if(i > 0 && order[i] == order[i - 1]) continue; // Listed twice
+            // The in-core copy is the newest (buffered appends may have added blocks)
+            int slot = inCoreSlot(order[i]);
+            iNode* node = node_list + order[i] % INODES_PER_BLOCK;
+            if(slot >= 0) {
+                *node = fdt.nodes[slot].node;
+                dropInCoreNode(slot);
+            }
+            node->next_orphan = super_block.orphan_head;
+            super_block.orphan_head = order[i];
+        }
+        saveINodeBlock(block_location);
+    }
+    pthread_mutex_unlock(&inode_cache_lock);
+    saveSuperBlock(); // Only after every orphan is on disk
+    free(order);
+    wakeReclaimer();
+}
+
+// Free the space of up to max_count iNodes from the orphan list (all if negative) - returns the number freed
+// The list head moves past a round of them (super block saved) before their space is freed (bit map saved), so a
+// crash in between leaks that space instead of freeing it twice once another file has taken it
+int reclaimOrphans(int max_count) {
+    int reclaimed = 0;
+    pthread_mutex_lock(&orphan_lock);
+    while(super_block.orphan_head >= 0 && (max_count < 0 || reclaimed < max_count)) {
+        iNode nodes[RECLAIM_BATCH];
+        int inode_indices[RECLAIM_BATCH];
+        int count = 0;
+        int head = super_block.orphan_head;
+        pthread_mutex_lock(&inode_cache_lock);
+        while(head >= 0 && count < RECLAIM_BATCH && (max_count < 0 || reclaimed + count < max_count)) {
+            nodes[count] = iNodeBlock(head / INODES_PER_BLOCK)[head % INODES_PER_BLOCK];
+            inode_indices[count++] = head;
+            head = nodes[count - 1].next_orphan;
+        }
+        pthread_mutex_unlock(&inode_cache_lock);
+
+        super_block.orphan_head = head;
+        saveSuperBlock();
+        for(int i = 0; i < count; i++) {
+            freeNodeBlocks(nodes + i);
+            free_inode_bit(inode_indices[i]);
+        }
+        saveFreeBitMapToDisk();
+        reclaimed += count;
+    }
+    pthread_mutex_unlock(&orphan_lock);
+    return reclaimed;
+}
+
+// Helper - make the tail buffer hold file block 'block' (block_local = bytes of it already in the file).
+// Allocates the block if it's new. Returns false if the block can't be given (disk full)
+static bool loadTailBlock(int fdt_index, int block, int block_local) {
+    InCoreNode* in_core = fdt.nodes + fdt.table[fdt_index].node_slot;
+    if(in_core->tail_block == block) return true;
+    flushFDTNode(fdt_index);
+
+    if(in_core->tail_buffer == NULL) {
+        in_core->tail_buffer = malloc(super_block.block_size);
+        if(in_core->tail_buffer == NULL) {
+            fprintf(stderr, "ERROR: Unable to allocate tail block buffer memory!\n");
+            return false;
+        }
+    }
+    int old_blocks_alloc = in_core->node.blocks_allocated;
+    int disk_idx = -1;
+    if(getNodeDataBlockList(&in_core->node, block, block, &disk_idx) < 0 || disk_idx < 0) return false;
+    // A block shared with a clone gets copied, the tail is written back to the copy
+    if(block < old_blocks_alloc && !unshareBlocks(&in_core->node, block, &disk_idx, 1, block_local != 0, false)) return false;
+    if(block_local != 0) read_blocks(disk_idx, 1, in_core->tail_buffer);
+
+    in_core->tail_block = block;
+    in_core->tail_disk_idx = disk_idx;
+    // A newly allocated block changed the iNode - save it with the tail
+    if(in_core->node.blocks_allocated != old_blocks_alloc) in_core->tail_dirty = true;
+    return true;
+}
+
+// Helper - append data at the end of file through the tail buffer. Blocks are only written
+// once they fill (or on flush/close), and the iNode is saved with them
+static long appendTailData(int fdt_index, const char* data, long data_size) {
+    InCoreNode* in_core = fdt.nodes + fdt.table[fdt_index].node_slot;
+    iNode* node = &in_core->node;
+    long bytes_written = 0;
+
+    while(bytes_written < data_size) {
+        int block = (int) (node->size / super_block.block_size);
+        int block_local = node->size % super_block.block_size;
+        if(block >= MAX_FILE_BLOCKS || !loadTailBlock(fdt_index, block, block_local)) break;
+
+        int chunk = super_block.block_size - block_local; // space left in block
+        if(data_size - bytes_written < chunk) chunk = data_size - bytes_written;
+        memcpy(in_core->tail_buffer + block_local, data + bytes_written, chunk);
+        bytes_written += chunk;
+        node->size += chunk;
+        in_core->tail_dirty = true;
+
+        if(block_local + chunk == super_block.block_size) flushFDTNode(fdt_index); // Block full
+    }
+    return bytes_written;
+}
+
+// Position within an sfs_iovec array, used to walk the segments block by block
+typedef struct VecCursor {
+    const sfs_iovec* iov;
+    int seg;       // Current segment
+    long seg_off;  // Bytes of the current segment already used
+} VecCursor;
+
+// Helper - copy data_size bytes between a flat buffer and the segments at the cursor (advancing it)
+static void copyVec(VecCursor* cursor, char* flat, long data_size, bool to_iov) {
+    while(data_size > 0) {
+        const sfs_iovec* seg = cursor->iov + cursor->seg;
+        long chunk = seg->len - cursor->seg_off;
+        if(data_size < chunk) chunk = data_size;
+        if(to_iov) memcpy((char*) seg->base + cursor->seg_off, flat, chunk);
+        else       memcpy(flat, (char*) seg->base + cursor->seg_off, chunk);
+        flat += chunk; data_size -= chunk;
+        cursor->seg_off += chunk;
+        if(cursor->seg_off >= seg->len) {
+            cursor->seg++;
+            cursor->seg_off = 0;
+        }
+    }
+}
+
+// Helper - if the next block_size bytes at the cursor lie in one segment, return them (so whole blocks
+// can go straight between disk and the caller's memory). Otherwise NULL
+static char* wholeBlockInSegment(VecCursor* cursor) {
+    while(cursor->seg_off >= cursor->iov[cursor->seg].len) { // Skip empty & used up segments
+        cursor->seg++;
+        cursor->seg_off = 0;
+    }
+    const sfs_iovec* seg = cursor->iov + cursor->seg;
+    if(seg->len - cursor->seg_off < super_block.block_size) return NULL;
+    return (char*) seg->base + cursor->seg_off;
+}
+
+// Helper - number of whole blocks (1 to max_blocks) at the cursor that lie in its segment and sit in consecutive
+// disk blocks (disk_data_idxs starts at the first), so they go between disk and memory in one call.
+// The cursor must be at a whole block (see wholeBlockInSegment)
+static int wholeBlockRun(VecCursor* cursor, const int* disk_data_idxs, int max_blocks) {
+    long in_segment = (cursor->iov[cursor->seg].len - cursor->seg_off) / super_block.block_size;
+    int run = 1;
+    while(run < max_blocks && run < in_segment && disk_data_idxs[run] == disk_data_idxs[run - 1] + 1) run++;
+    return run;
+}
+
+// Helper - total bytes held by the segments
+static long vecLength(const sfs_iovec* iov, int iovcnt) {
+    long total = 0;
+    for(int i = 0; i < iovcnt; i++) {
+        if(iov[i].len > 0) total += iov[i].len;
+    }
+    return total;
+}
+
+// Write the segments (in order) into the fdt entry's iNode at byte offset, overwriting.
+// Blocks of the whole range are found once. Does not move read/write pointers
+long overwriteDataVecAt(int fdt_index, const sfs_iovec* iov, int iovcnt, long offset) {
+    iNode* node = fdtNode(fdt_index);
+    long data_size = vecLength(iov, iovcnt);
+    if(data_size <= 0 || offset < 0 || offset > node->size) return 0;
+
+    // Small appends are buffered, anything else works on the disk copy of the tail
+    if(offset == node->size && data_size < super_block.block_size) {
+        long bytes_written = 0;
+        for(int i = 0; i < iovcnt; i++) {
+            if(iov[i].len <= 0) continue;
+            long seg_written = appendTailData(fdt_index, iov[i].base, iov[i].len);
+            bytes_written += seg_written;
+            if(seg_written < iov[i].len) break;
+        }
+        return bytes_written;
+    }
+    flushFDTNode(fdt_index);
 
     // Check for writing past max file size (clamp to max file size if so)
-    int last_write_block = (int) ((fdt_e->writePointer + data_size - 1) / super_block.block_size); // ex wP=0, data_size = block_size
+    int last_write_block = (int) ((offset + data_size - 1) / super_block.block_size); // ex offset=0, data_size = block_size
     if(last_write_block >= MAX_FILE_BLOCKS) {
-        data_size = ((long) MAX_FILE_BLOCKS)*super_block.block_size - fdt_e->writePointer;
+        data_size = ((long) MAX_FILE_BLOCKS)*super_block.block_size - offset;
         last_write_block = MAX_FILE_BLOCKS - 1; // zero-index
     }
     if(data_size <= 0) return 0;
 
     // Fill an indices array of data blocks written
-    int cur_write_block = (int) (fdt_e->writePointer / super_block.block_size);
+    int cur_write_block = (int) (offset / super_block.block_size);
     int blocks_written = last_write_block - cur_write_block + 1;
     int* disk_data_idxs = malloc(sizeof(int) * blocks_written);
     int num_existing = getNodeDataBlockList(node, cur_write_block, last_write_block, disk_data_idxs);
@@ -307,32 +1140,56 @@ long overwriteData(int fdt_index, const void* data_buffer, long data_size) {
     if(num_existing < 0) {
         // Not all blocks could be created. See how many were created & adjust
         num_existing *= -1;
-        data_size = ((long) node->blocks_allocated)*super_block.block_size - fdt_e->writePointer;
+        data_size = ((long) node->blocks_allocated)*super_block.block_size - offset;
     }
 
-    if(data_size <= 0) return 0;
-    long bytes_added = (fdt_e->writePointer + data_size) - node->size; // bytes appended to end of file
+    if(data_size <= 0) {
+        free(disk_data_idxs);
+        return 0;
+    }
+
+    // Blocks shared with a clone get copied first (only the partly written ones need their data)
+    int write_block_local = offset % super_block.block_size; // offset in block
+    int existing = (num_existing < blocks_written) ? num_existing : blocks_written;
+    if(existing > 0 && !unshareBlocks(node, cur_write_block, disk_data_idxs, existing, 
+                                      write_block_local != 0 || data_size < super_block.block_size,
+                                      existing == blocks_written && (offset + data_size) % super_block.block_size != 0)) {
+        free(disk_data_idxs);
+        saveFDTNode(fdt_index); // New blocks may have been added
+        return 0;
+    }
+    long bytes_added = (offset + data_size) - node->size; // bytes appended to end of file
     if(bytes_added <= 0) bytes_added = 0;
     node->size += bytes_added;
 
     // Use data block indices array to fill data blocks with data (pure overwrite)
-    int write_block_local = fdt_e->writePointer % super_block.block_size; // offset in block
-    int left_to_write = data_size; // Amount of data left to be written in
+    VecCursor cursor = {.iov = iov, .seg = 0, .seg_off = 0};
+    long left_to_write = data_size; // Amount of data left to be written in
     int remaining_size = super_block.block_size - write_block_local; // space left in block to write
     if(data_size < remaining_size) remaining_size = data_size;
     char* block_buffer = malloc(super_block.block_size);
 
     // Actual write operation
-    for(int i = 0; left_to_write > 0; i++) {
-            // Save existing if unwritten data in block
-            if(i < num_existing && (write_block_local != 0 || left_to_write < super_block.block_size)) {
-                read_blocks(disk_data_idxs[i], 1, block_buffer);
+    int run;
+    for(int i = 0; left_to_write > 0; i += run) {
+            run = 1;
+            char* direct = (remaining_size == super_block.block_size) ? wholeBlockInSegment(&cursor) : NULL;
+            if(direct != NULL) {
+                // Whole blocks sit in one segment, no need to stage them. Consecutive disk blocks go in one write
+                run = wholeBlockRun(&cursor, disk_data_idxs + i, (int) (left_to_write / super_block.block_size));
+                write_blocks(disk_data_idxs[i], run, direct);
+                cursor.seg_off += (long) run * super_block.block_size;
+            } else {
+                // Save existing if unwritten data in block
+                if(i < num_existing && (write_block_local != 0 || left_to_write < super_block.block_size)) {
+                    read_blocks(disk_data_idxs[i], 1, block_buffer);
+                }
+                copyVec(&cursor, block_buffer + write_block_local, remaining_size, false);
+                write_blocks(disk_data_idxs[i], 1, block_buffer);
             }
-            memcpy(block_buffer + write_block_local, data, remaining_size);
-            write_blocks(disk_data_idxs[i], 1, block_buffer);
 
             // Update internal vals
-            data += remaining_size; left_to_write -= remaining_size;
+            left_to_write -= (long) run * remaining_size;
             write_block_local = 0;
             remaining_size = (left_to_write < super_block.block_size) ? left_to_write : super_block.block_size;
     }
@@ -341,29 +1198,41 @@ long overwriteData(int fdt_index, const void* data_buffer, long data_size) {
     free(disk_data_idxs);
 
     // Update iNode
-    fdt_e->writePointer += data_size;
     saveFDTNode(fdt_index);
     return data_size;
 }
 
+// Write data into the fdt entry's iNode at byte offset, overwriting. Does not move read/write pointers
+long overwriteDataAt(int fdt_index, const void* data_buffer, long data_size, long offset) {
+    sfs_iovec iov = {.base = (void*) data_buffer, .len = data_size};
+    return overwriteDataVecAt(fdt_index, &iov, 1, offset);
+}
+
+// Write data into inode_e's iNode, overwriting based on write pointer
+long overwriteData(int fdt_index, const void* data_buffer, long data_size) {
+    long bytes_written = overwriteDataAt(fdt_index, data_buffer, data_size, fdt.table[fdt_index].writePointer);
+    fdt.table[fdt_index].writePointer += bytes_written;
+    return bytes_written;
+}
+
 
 // UNUSED: appends data without overwriting existing
 // If not enough space in FILE, will limit amount written
 // If not enough space in FILE SYSTEM, data will be deleted from the end to fit appended
 long appendData(int fdt_index, const void* data_buffer, long data_size) {
     if(data_size <= 0) return 0;
-    int new_blocks_alloc = (int) ((fdt.inodes[fdt_index].size + data_size) / super_block.block_size);
+    int new_blocks_alloc = (int) ((fdtNode(fdt_index)->size + data_size) / super_block.block_size);
     if(new_blocks_alloc >= MAX_FILE_BLOCKS) {
-        data_size =  ((long)MAX_FILE_BLOCKS*super_block.block_size) - fdt.inodes[fdt_index].size;
+        data_size =  ((long)MAX_FILE_BLOCKS*super_block.block_size) - fdtNode(fdt_index)->size;
     }
 
     // If we're writing to the end, act the same as overwrite
-    if(fdt.table[fdt_index].writePointer == fdt.inodes[fdt_index].size) {
+    if(fdt.table[fdt_index].writePointer == fdtNode(fdt_index)->size) {
         return overwriteData(fdt_index, data_buffer, data_size);
     }
 
     // Otherwise, we have data to save
-    long save_size = fdt.inodes[fdt_index].size - fdt.table[fdt_index].writePointer;
+    long save_size = fdtNode(fdt_index)->size - fdt.table[fdt_index].writePointer;
     char* save_data = malloc(save_size);
 
     long old_read_pointer = fdt.table[fdt_index].readPointer;
@@ -380,48 +1249,108 @@ long appendData(int fdt_index, const void* data_buffer, long data_size) {
     return data_size;
 }
 
-// Fill the data in inode_e into buffer according to the read pointer
-long readData(int fdt_index,  void* data_buffer, long data_size) {
+// Fill the segments (in order) with the fdt entry's iNode data starting at byte offset.
+// Blocks of the whole range are found once. Does not move read/write pointers
+long readDataVecAt(int fdt_index, const sfs_iovec* iov, int iovcnt, long offset) {
+    InCoreNode* in_core = fdt.nodes + fdt.table[fdt_index].node_slot;
+    iNode* node = &in_core->node;
+    long data_size = vecLength(iov, iovcnt);
+    if(offset < 0) return 0;
+    if(data_size + offset > node->size) data_size = node->size - offset;
     if (data_size <= 0) return 0;
-    char* data = (char*) data_buffer;
-    FDTEntry fdt_e = fdt.table[fdt_index];
-    iNode* node = fdt.inodes + fdt_index;
-    if(data_size + fdt_e.readPointer > node->size) data_size = node->size - fdt_e.readPointer;
     long bytes_read = data_size;
 
 
     // Grab indices of data blocks to read
-    int cur_block = (int) (fdt_e.readPointer / super_block.block_size);
-    int last_block = (int) ((fdt_e.readPointer + data_size - 1) / super_block.block_size);
+    int cur_block = (int) (offset / super_block.block_size);
+    int last_block = (int) ((offset + data_size - 1) / super_block.block_size);
     int* disk_data_idxs = malloc(sizeof(int) * (last_block - cur_block + 1));
     getNodeDataBlockList(node, cur_block, last_block, disk_data_idxs);
 
     // init current location variables
-    int cur_block_local = fdt_e.readPointer % super_block.block_size;
+    VecCursor cursor = {.iov = iov, .seg = 0, .seg_off = 0};
+    int cur_block_local = offset % super_block.block_size;
     int remaining_size = super_block.block_size - cur_block_local; // remaining data to be read in a block
     if( data_size < remaining_size) remaining_size = data_size;
 
     char* block_buffer = malloc(super_block.block_size); // Holds block read data from disk
-    for(int i = 0; data_size > 0; i++) {
-        read_blocks(disk_data_idxs[i], 1, block_buffer);
-        memcpy(data, block_buffer + cur_block_local, remaining_size);
-        data += remaining_size; data_size -= remaining_size;
+    int run;
+    for(int i = 0; data_size > 0; i += run) {
+        run = 1;
+        char* direct = (remaining_size == super_block.block_size) ? wholeBlockInSegment(&cursor) : NULL;
+        // Buffered tail block is newer than the disk copy
+        if(cur_block + i == in_core->tail_block) {
+            copyVec(&cursor, in_core->tail_buffer + cur_block_local, remaining_size, true);
+        } else if(direct != NULL) {
+            // Whole blocks go in one segment, no need to stage them. Consecutive disk blocks come in one read
+            int max_blocks = (int) (data_size / super_block.block_size);
+            if(in_core->tail_block > cur_block + i && in_core->tail_block - (cur_block + i) < max_blocks) {
+                max_blocks = in_core->tail_block - (cur_block + i); // Stop before the buffered tail
+            }
+            run = wholeBlockRun(&cursor, disk_data_idxs + i, max_blocks);
+            read_blocks(disk_data_idxs[i], run, direct);
+            cursor.seg_off += (long) run * super_block.block_size;
+        } else {
+            read_blocks(disk_data_idxs[i], 1, block_buffer);
+            copyVec(&cursor, block_buffer + cur_block_local, remaining_size, true);
+        }
+        data_size -= (long) run * remaining_size;
         cur_block_local = 0; 
         remaining_size = (data_size < super_block.block_size) ? data_size : super_block.block_size;
     }
     free(block_buffer);
     free(disk_data_idxs);
-    fdt.table[fdt_index].readPointer += bytes_read;
     // No modifications = no saves needed
     return bytes_read;
 }
 
+// Fill buffer with the fdt entry's iNode data starting at byte offset. Does not move read/write pointers
+long readDataAt(int fdt_index, void* data_buffer, long data_size, long offset) {
+    sfs_iovec iov = {.base = data_buffer, .len = data_size};
+    return readDataVecAt(fdt_index, &iov, 1, offset);
+}
+
+// Copy data_size bytes of src_fdt's iNode from src_offset to dst_fdt's iNode at dst_offset (<= its size), overwriting.
+// Goes through a buffer of at most COPY_BUFFER_BLOCKS blocks, each chunk ending on a destination block boundary so
+// whole blocks go straight between disk and the buffer. Does not move read/write pointers (returns bytes copied)
+long copyDataAt(int src_fdt, long src_offset, int dst_fdt, long dst_offset, long data_size) {
+    if(src_offset < 0 || dst_offset < 0 || dst_offset > fdtNode(dst_fdt)->size) return 0;
+    if(data_size > fdtNode(src_fdt)->size - src_offset) data_size = fdtNode(src_fdt)->size - src_offset;
+    if(data_size <= 0) return 0;
+
+    long buffer_size = (long) COPY_BUFFER_BLOCKS * super_block.block_size;
+    char* buffer = malloc((data_size < buffer_size) ? data_size : buffer_size);
+    if(buffer == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate copy buffer memory!\n");
+        return 0;
+    }
+    long copied = 0;
+    while(copied < data_size) {
+        long chunk = buffer_size - (dst_offset + copied) % super_block.block_size;
+        if(chunk > data_size - copied) chunk = data_size - copied;
+        long bytes_read = readDataAt(src_fdt, buffer, chunk, src_offset + copied);
+        long bytes_written = (bytes_read > 0) ? overwriteDataAt(dst_fdt, buffer, bytes_read, dst_offset + copied) : 0;
+        copied += bytes_written;
+        if(bytes_written < chunk) break; // Disk or file full
+    }
+    free(buffer);
+    return copied;
+}
+
+// Fill the data in inode_e into buffer according to the read pointer
+long readData(int fdt_index,  void* data_buffer, long data_size) {
+    long bytes_read = readDataAt(fdt_index, data_buffer, data_size, fdt.table[fdt_index].readPointer);
+    fdt.table[fdt_index].readPointer += bytes_read;
+    return bytes_read;
+}
+
 // Note: deletes data BEFORE write pointer (non-inclusive)
 // data_size = amount of data to delete (in bytes)
 long deleteData(int fdt_index, long data_size) {
     // Possible feature to add: a buffer parameter that this method will fill with the deleted data
+    flushFDTNode(fdt_index);
     FDTEntry* fdt_e = fdt.table + fdt_index;
-    iNode* node = fdt.inodes + fdt_index;
+    iNode* node = fdtNode(fdt_index);
 
     // Clamp delete
     if(data_size > fdt_e->writePointer) data_size = fdt_e->writePointer;
@@ -457,6 +1386,16 @@ long deleteData(int fdt_index, long data_size) {
         remaining_size = (save_size_tmp < super_block.block_size) ? save_size_tmp : super_block.block_size;
     }
 
+    // Blocks rewritten below that are shared with a clone get copied first (only the first keeps its data)
+    long new_write_pointer = fdt_e->writePointer - data_size;
+    int rewritten = (save_size > 0) ? (int) ((new_write_pointer + save_size - 1) / super_block.block_size) - start_write_block + 1 : 0;
+    if(!unshareBlocks(node, start_write_block, disk_data_idxs, rewritten, new_write_pointer % super_block.block_size != 0, false)) {
+        free(block_buffer);
+        free(saved_data);
+        free(disk_data_idxs);
+        return 0;
+    }
+
     // Now we start writing save data from decremented write pointer
     fdt_e->writePointer -= data_size; 
     save_size_tmp = save_size;
@@ -489,7 +1428,11 @@ long deleteData(int fdt_index, long data_size) {
     // We now free unwritten blocks
     node->size -= data_size;
     int old_blocks_alloc = node->blocks_allocated;
-    node->blocks_allocated -= (blocks_affected - i); // i is 1 after the last disk_data_idxs index written to
+    // Keep every block still holding data. Nothing is rewritten when deleting from the end, so the
+    // count can't come from the write loop above
+    int kept_blocks = (int) ((node->size + super_block.block_size - 1) / super_block.block_size);
+    node->blocks_allocated = kept_blocks;
+    i = kept_blocks - start_write_block;
     for(; i < blocks_affected; i++) {
         free_data_bit(disk_data_idxs[i]);
     }
@@ -3,10 +3,11 @@
 
 #include "sfs_free_bit_map.h"
 #include "sfs_super_block.h"
+#include "sfs_api.h" // Need for sfs_iovec
 #include <stdbool.h>
 #include <stdlib.h> 
 
-// NOTE: uid, gid, file_id, link_count currently aren't used (though file_id is set).
+// NOTE: uid, gid, file_id currently aren't used (though file_id is set).
 // They are there in case I want to expand on this system at some point.
 typedef struct iNode {
   bool is_directory;                // Directory (1) or file (0)
@@ -21,51 +22,155 @@ typedef struct iNode {
   int direct_pointer[12];           // Direct block pointers
   int indirect_pointer;             // Pointer to block holding direct block pointers
   int double_indirect_pointer;      // Pointer to block holding indirect block pointers
+  int next_orphan;                  // Next iNode on the orphan list (only while on it, -1 ends the list)
 } iNode;
 
 
+// In-core copy of an iNode - one per open iNode, shared by every fdt entry (open handle) using it
+typedef struct InCoreNode {
+    iNode node;
+    int inode_idx;      // Index of the iNode on disk (-1 if slot unused)
+    int ref_count;      // Number of fdt entries using this iNode
+
+    // Small appends collect in the file's partial last block (tail) before going to disk
+    char* tail_buffer;  // Cached copy of the tail block (NULL until the first small append)
+    int tail_block;     // File block index held in tail_buffer (-1 if none)
+    int tail_disk_idx;  // Disk block index of the tail block
+    bool tail_dirty;    // Tail block and iNode have changes not yet saved to disk
+} InCoreNode;
+
+
+// One open handle of an iNode, each with its own read/write pointers
 typedef struct FDTEntry {
-    int inode_idx;
+    int inode_idx;  // Index of the iNode on disk (-1 if entry unused)
+    int node_slot;  // Index of the shared iNode in fdt.nodes
     long readPointer;
     long writePointer;
+    sfs_session* owner; // Session that opened it through the API (NULL for handles used inside the file system)
 } FDTEntry;
 
 
 struct FileDescriptorTable_s {
-    FDTEntry* table; // Holds indices & read/write pointers
-    iNode* inodes; // This is the cached iNode table
+    FDTEntry* table; // Holds open handles (indices & read/write pointers)
+    InCoreNode* nodes; // This is the cached iNode table (shared between handles)
 
     // For cache only
-    int size; // Number of FDT entries (open iNodes)
-    int allocated;  // size allocated to map (in entries)
+    int size; // Number of FDT entries (open handles)
+    int allocated;  // size allocated to table (in entries) - grows by doubling, indices never move
+    int* free_slots; // Stack of unused fdt indices
+    int free_count;  // Number of unused fdt indices in free_slots
+
+    int node_count;      // Number of in-core iNodes
+    int nodes_allocated; // size allocated to nodes (in entries) - grows by doubling, indices never move
+    int* free_nodes;     // Stack of unused node slots
+    int free_node_count; // Number of unused node slots in free_nodes
+    int* inode_map;  // Open addressing hash of iNode index -> node slot (-1 = empty slot)
+    int map_size;    // Slots in inode_map (power of 2, twice nodes_allocated)
 };
 typedef struct FileDescriptorTable_s FileDescriptorTable;
 
-extern SuperBlock super_block;
-extern FileDescriptorTable fdt;
-extern int INODES_PER_BLOCK, MAX_FILE_ID, MAX_FILE_BLOCKS, POINTERS_PER_BLOCK;
+// super_block, fdt and the constants (INODES_PER_BLOCK, ...) are those of the file system the calling thread uses
+#include "sfs_instance.h"
+
+// The (shared) in-core iNode an fdt entry refers to
+static inline iNode* fdtNode(int fdt_index) {
+    return &fdt.nodes[fdt.table[fdt_index].node_slot].node;
+}
+
+// Lock the iNode of an fdt entry for I/O from several threads: shared to read it, exclusive to write it or move
+// the entry's pointers. Locks are striped by iNode index, so files rarely (harmlessly) share one
+void lockFDTNode(int fdt_index, bool exclusive);
+void unlockFDTNode(int fdt_index);
+
+// Lock (exclusive) the iNodes of two fdt entries in a fixed order, for a copy between them
+void lockFDTNodePair(int fdt_a, int fdt_b);
+void unlockFDTNodePair(int fdt_a, int fdt_b);
 
-// Load an inode from disk into the file descriptor table - returns index
+// Open a new handle on an inode (loading it from disk if not in-core already) - returns fdt index
 int openFDTNode(int inode_index);
 
-// DOES NOT SAVE - saving should be done continuously over program
+// Closes the handle. Last handle on an iNode saves buffered appends (flushFDTNode) - other saving is
+// done continuously over program
 void closeFDTNode(int fdt_index);
 
-// Create empty iNode and return the fdt index
+// Write any buffered tail block (and the iNode it changed) to disk
+void flushFDTNode(int fdt_index);
+
+// Write the in-core iNode of the handle to disk now (after changing a field such as link_count)
+void saveFDTNode(int fdt_index);
+
+// Copy the iNodes with the given indices into nodes (in-core copies if loaded), reading each iNode table block once
+// Needs fs_lock shared at least (in-core copies are read under their iNode lock)
+void readINodes(const int* inode_indices, int count, iNode* nodes);
+
+// Load the iNode table blocks holding the given iNodes into the iNode cache, reading runs of blocks together
+void prefetchINodes(const int* inode_indices, int count);
+
+// Empty the iNode table block cache (call when a file system is created or loaded)
+void resetINodeCache();
+
+// Hold back iNode table, free bit map and super block writes (only marking them dirty) until the matching
+// releaseSaves, which writes each changed block once. Holds nest, the outermost release writes. fs_lock held exclusively
+// flushSaves writes what is held so far without ending the hold, before a write that must not reach disk ahead of it
+void holdSaves();
+void flushSaves();
+void releaseSaves();
+
+// Make the (empty) iNode caches and locks of a new file system (NULL if out of memory), or free those of one unmounted
+INodeCaches* newINodeCaches();
+void freeINodeCaches(INodeCaches* caches);
+
+// Create empty iNode (with one link, for the entry it is created for) and return the fdt index
 int createINode(bool is_directory);
 
-// Returns deleted node - clears disk data - removes from fdt
+// Create count empty iNodes (one bitmap save, each iNode table block written once), their fdt indices go in fdt_indices
+// Returns count, or -1 with nothing created if they don't all fit
+int createINodes(int count, bool is_directory, int* fdt_indices);
+
+// Create a new file iNode with the data of the one at src_fdt, sharing its data blocks (copied on write).
+// Returns the clone's fdt index, or -1 if the disk is full
+int cloneINode(int src_fdt);
+
+// Returns deleted node - clears disk data - removes it (and every handle on it) from fdt
 FDTEntry deleteINode(int fdt_index);
 
+// Deletes the iNodes with the given indices (and their data, and any handles on them) with one bit map save
+void deleteINodes(const int* inode_indices, int count);
+
+// Put the iNodes with the given indices on the orphan list (kept on disk) instead of deleting them: any handles
+// on them are dropped, their space is freed later by reclaimOrphans (the background reclaimer is woken for it,
+// and allocations free a batch when the disk runs out). Each iNode table block is written once
+void orphanINodes(const int* inode_indices, int count);
+
+// Free the space of up to max_count iNodes from the orphan list (all if negative), RECLAIM_BATCH at a time: the
+// list head is saved past them before the bit map is saved with their space freed. Returns the number of iNodes freed
+int reclaimOrphans(int max_count);
+
 // Write data into inode_e's iNode, overwriting based on write pointer (returns bytes written)
 long overwriteData(int fdt_index, const void* data_buffer, long data_size);
 
+// Write data into the fdt entry's iNode at byte offset (<= size), leaving pointers alone (returns bytes written)
+long overwriteDataAt(int fdt_index, const void* data_buffer, long data_size, long offset);
+
+// Write the segments (in order) into the iNode at byte offset (<= size), leaving pointers alone (returns bytes written)
+long overwriteDataVecAt(int fdt_index, const sfs_iovec* iov, int iovcnt, long offset);
+
 // UNUSED: insert data at writePointer location (not overwriting existing data)
 long appendData(int fdt_index, const void* data_buffer, long data_size);
 
 // Fill the data in inode_e into buffer according to the read pointer (returns bytes read)
 long readData(int fdt_index,  void* data_buffer, long data_size);
 
+// Fill buffer with the fdt entry's iNode data from byte offset, leaving pointers alone (returns bytes read)
+long readDataAt(int fdt_index, void* data_buffer, long data_size, long offset);
+
+// Fill the segments (in order) with iNode data from byte offset, leaving pointers alone (returns bytes read)
+long readDataVecAt(int fdt_index, const sfs_iovec* iov, int iovcnt, long offset);
+
+// Copy data_size bytes from src_offset of one iNode to dst_offset (<= size) of another through a bounded buffer,
+// leaving pointers alone (returns bytes copied)
+long copyDataAt(int src_fdt, long src_offset, int dst_fdt, long dst_offset, long data_size);
+
 // Deletes data_size (in bytes) before write pointer pointer (non-inclusive) (returns # bytes deleted)
 long deleteData(int fdt_index, long data_size);
 
@@ -0,0 +1,89 @@
+#ifndef SFS_INSTANCE_H
+#define SFS_INSTANCE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "sfs_api.h"
+#include "sfs_super_block.h"
+#include "disk_emu.h"
+
+struct FileDescriptorTable_s; // sfs_inode.h
+
+// State of each layer, private to its source file (one of each per file system)
+typedef struct INodeCaches INodeCaches;         // sfs_inode.c
+typedef struct FreeBitMap FreeBitMap;           // sfs_free_bit_map.c
+typedef struct DirectoryCaches DirectoryCaches; // sfs_directory.c
+typedef struct DirectoryWindow DirectoryWindow; // sfs_directory.c
+
+// A client's view of the file system. Names are relative to its current directory, and it closes the handles it opened
+struct sfs_session {
+    sfs_t* fs;          // File system the session was opened on
+    int cur_inode;      // iNode of the current directory (pinned in the directory layer), -1 before mksfs
+    int iterator_index; // Position of the directory listing (sfs_getnextentry, sfs_readdirplus)
+    DirectoryWindow* listing; // Records of the listing read ahead (NULL until the first listing)
+    pthread_mutex_t listing_lock; // Held while listing moves iterator_index & listing (listings hold fs_lock shared)
+    sfs_session* next;  // Next open session
+};
+
+// One mounted file system: its image, everything cached from it and its locks
+struct sfs_t {
+    char* disk_name;
+    disk_t* disk;              // NULL for the disk emulator's default disk
+    SuperBlock geometry;       // Block size, size & iNode table length mksfs(1) formats with
+
+    SuperBlock super;          // The layers use these two as super_block and fdt
+    struct FileDescriptorTable_s* files;
+    int pointers_per_block;
+    int inodes_per_block;
+    int max_file_blocks;
+    int max_file_id;
+    bool prefetch_on_load;     // sfs_loaddir prefetches the iNodes of the directory's entries
+
+    INodeCaches* inode_caches;
+    FreeBitMap* bit_map;
+    DirectoryCaches* directory_caches;
+
+    // While above 0 (a batch being submitted), iNode table, free bit map and super block changes stay in memory
+    // and are only marked dirty, to be written before the next directory write or when the count drops back to 0
+    // (see holdSaves)
+    int saves_held;
+    bool super_dirty;          // super changed while saves were held
+
+    // Calls without a session (sfs_fopen, sfs_loaddir, ...) use the default session
+    sfs_session default_session;
+    sfs_session* sessions;     // Every open session, the default one last
+
+    // Calls that open or close handles, or touch directories (and the caches behind them), hold fs_lock exclusively.
+    // Reads and writes of open files hold it shared, so the fdt can't grow (move) under them, plus their file's iNode lock
+    pthread_rwlock_t fs_lock;
+
+    // Thread freeing the space of removed files (orphans) in the background, started by the first wakeReclaimer
+    pthread_t reclaimer;
+    bool reclaimer_running;
+    bool reclaim_wanted;  // Orphans were added since the reclaimer last looked
+    bool reclaimer_stop;  // Set by sfs_unmount
+    pthread_mutex_t reclaim_lock; // Held while using the four above
+    pthread_cond_t reclaim_cond;
+
+    int async_requests;   // Asynchronous requests started on it, queued or running (sfs_async, under its lock)
+};
+
+// File system the calling thread's calls use (sfs_use), defined in sfs_api
+extern __thread sfs_t* cur_fs;
+
+// Have the background reclaimer of the calling thread's file system free the orphan list, a batch at a time
+// (starting it if needed). Defined in sfs_api
+void wakeReclaimer();
+
+// Wait until every asynchronous request started on fs has run (and its callback returned). Defined in sfs_async
+void waitAsyncRequests(sfs_t* fs);
+
+// The layers name the state of the file system they work on as if it were global
+#define super_block (cur_fs->super)
+#define fdt (*cur_fs->files)
+#define POINTERS_PER_BLOCK (cur_fs->pointers_per_block)
+#define INODES_PER_BLOCK (cur_fs->inodes_per_block)
+#define MAX_FILE_BLOCKS (cur_fs->max_file_blocks)
+#define MAX_FILE_ID (cur_fs->max_file_id)
+
+#endif
@@ -1,4 +1,5 @@
 #include "sfs_super_block.h"
+#include "sfs_instance.h"
 #include "disk_emu.h"
 #include <stdlib.h>
 #include <string.h>
@@ -11,10 +12,21 @@ void readSuperBlock() {
     free(read_buff);
 }
 
-// Save super block after changes
-void saveSuperBlock() {
+static void writeSuperBlock() {
     char* write_buff = malloc(super_block.block_size);
     memcpy(write_buff, &super_block, sizeof(SuperBlock));
     write_blocks(0, 1, write_buff);
     free(write_buff);
-}
\ No newline at end of file
+}
+
+// Save super block after changes (only marked dirty while saves are held)
+void saveSuperBlock() {
+    if(cur_fs->saves_held > 0) cur_fs->super_dirty = true;
+    else writeSuperBlock();
+}
+// Write the super block if it changed while saves were held
+void flushSuperBlock() {
+    if(!cur_fs->super_dirty) return;
+    cur_fs->super_dirty = false;
+    writeSuperBlock();
+}
@@ -1,7 +1,7 @@
 #ifndef SFS_SUPER_BLOCK_H
 #define SFS_SUPER_BLOCK_H
 
-#define SUPPORTED_SYSTEM 0xACBD0005
+#define SUPPORTED_SYSTEM 0xACBD000A
 
 struct _SuperBlock {
     unsigned int magic_number;    // Unique file_system ID #
@@ -9,16 +9,17 @@ struct _SuperBlock {
     int file_system_size;         // In blocks
     int inode_table_length;       // In blocks
     int root_directory;           // iNode # of root directory
+    int orphan_head;              // iNode # of the first removed iNode whose space is not freed yet (-1 if none)
 };
 typedef struct _SuperBlock SuperBlock;
 
-// Global super_block, defined in sfs_api
-extern SuperBlock super_block;
-
 // Read super block from memory
 void readSuperBlock();
 
 // Save super block after changes
 void saveSuperBlock();
 
+// Write the super block if it changed while saves were held (see holdSaves)
+void flushSuperBlock();
+
 #endif
@@ -89,9 +89,13 @@ main(int argc, char **argv)
       fprintf(stderr, "ERROR: creating first test file %s\n", names[i]);
       error_count++;
     } 
+    /* A second open gets its own handle (and read/write pointer) */
     tmp = sfs_fopen(names[i]);
-    if (tmp >= 0 && tmp != fds[i]) {
-      fprintf(stderr, "ERROR: file %s was opened twice\n", names[i]);
+    if (tmp < 0 || tmp == fds[i]) {
+      fprintf(stderr, "ERROR: second open of file %s did not get its own handle\n", names[i]);
+      error_count++;
+    } else if (sfs_fclose(tmp) != 0) {
+      fprintf(stderr, "ERROR: close of second handle on file %s failed\n", names[i]);
       error_count++;
     }
     filesize[i] = (rand() % (MAX_BYTES-MIN_BYTES)) + MIN_BYTES;
@@ -284,10 +288,91 @@ main(int argc, char **argv)
     }
   }
   printf("ok\n");
+
+  /* Many small appends (buffered in the tail block) should read back
+   * the same before and after the file system is reloaded.
+   */
+  char *log_name = rand_name();
+  int log_fd = sfs_fopen(log_name);
+  for (i = 0; i < 50; i++) {
+    memset(fixedbuf, 'a' + (i % 26), 100);
+    if (sfs_fwrite(log_fd, fixedbuf, 100) != 100) {
+      fprintf(stderr, "ERROR: Small append %d to %s failed\n", i, log_name);
+      error_count++;
+    }
+  }
+  sfs_fseek(log_fd, 0);
+  for (i = 0; i < 50; i++) {
+    if (sfs_fread(log_fd, fixedbuf, 100) != 100 || fixedbuf[0] != 'a' + (i % 26) || fixedbuf[99] != 'a' + (i % 26)) {
+      fprintf(stderr, "ERROR: Small append %d read back wrong from %s\n", i, log_name);
+      error_count++;
+      break;
+    }
+  }
+  /* Positional writes and reads must leave the file pointer (now at the end) alone.
+   */
+  if (sfs_pwrite(log_fd, "ZZ", 2, 150) != 2) {
+    fprintf(stderr, "ERROR: Positional write to %s failed\n", log_name);
+    error_count++;
+  }
+  if (sfs_pread(log_fd, fixedbuf, 4, 149) != 4 || memcmp(fixedbuf, "bZZb", 4) != 0) {
+    fprintf(stderr, "ERROR: Positional read from %s did not see positional write\n", log_name);
+    error_count++;
+  }
+  if (sfs_fread(log_fd, fixedbuf, 1) != 0) {
+    fprintf(stderr, "ERROR: Positional read/write moved the file pointer of %s\n", log_name);
+    error_count++;
+  }
+  /* A vectored write gathers header, payload and trailer into one record,
+   * and a vectored read scatters it back out.
+   */
+  {
+    char head[8] = "HEAD", tail[8] = "TAIL", payload[1500], check[3][1500];
+    memset(payload, 'p', sizeof(payload));
+    sfs_iovec rec[3] = {{head, 4}, {payload, sizeof(payload)}, {tail, 4}};
+    sfs_iovec back[3] = {{check[0], 4}, {check[1], sizeof(payload)}, {check[2], 4}};
+    if (sfs_fwritev(log_fd, rec, 3) != 1508) {
+      fprintf(stderr, "ERROR: Vectored write to %s failed\n", log_name);
+      error_count++;
+    }
+    if (sfs_preadv(log_fd, back, 3, 5000) != 1508 || memcmp(check[0], "HEAD", 4) != 0 ||
+        memcmp(check[1], payload, sizeof(payload)) != 0 || memcmp(check[2], "TAIL", 4) != 0) {
+      fprintf(stderr, "ERROR: Vectored read from %s did not match vectored write\n", log_name);
+      error_count++;
+    }
+    if (sfs_pread(log_fd, fixedbuf, 4, 6504) != 4 || memcmp(fixedbuf, "TAIL", 4) != 0) {
+      fprintf(stderr, "ERROR: Vectored write to %s did not land in order\n", log_name);
+      error_count++;
+    }
+  }
+  /* Two handles on one file keep separate pointers, and closing one
+   * leaves the other open.
+   */
+  {
+    int reader = sfs_fopen(log_name);
+    sfs_fseek(reader, 0);
+    if (sfs_fread(reader, fixedbuf, 4) != 4 || memcmp(fixedbuf, "aaaa", 4) != 0 ||
+        sfs_fread(log_fd, fixedbuf, 1) != 0) {
+      fprintf(stderr, "ERROR: Handles on %s share a file pointer\n", log_name);
+      error_count++;
+    }
+    sfs_fclose(reader);
+    if (sfs_pread(log_fd, fixedbuf, 4, 0) != 4) {
+      fprintf(stderr, "ERROR: Closing one handle on %s closed the other\n", log_name);
+      error_count++;
+    }
+  }
+  sfs_fflush(log_fd);
+
   /* Now we try to re-initialize the system.
    */
   mksfs(0);
 
+  if (sfs_getfilesize(log_name) != 6508) {
+    fprintf(stderr, "ERROR: Small appends to %s lost on reload (size %d)\n", log_name, sfs_getfilesize(log_name));
+    error_count++;
+  }
+
   for (i = 0; i < nopen; i++) {
     fds[i] = sfs_fopen(names[i]);
     sfs_fseek(fds[i], 0);
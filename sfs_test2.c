@@ -84,10 +84,10 @@ main(int argc, char **argv)
   /* First we open two files and attempt to write data to them.
    */
   {
-  char fname[MAX_FNAME_LENGTH+10];
+  char fname[MAXFILENAME+11];
   int i;
 
-  for (i = 0; i < MAX_FNAME_LENGTH+10; i++) {
+  for (i = 0; i < MAXFILENAME+10; i++) {
     if (i != 8) {
       fname[i] = 'A' + (rand() % 26);
     }
@@ -111,9 +111,13 @@ main(int argc, char **argv)
       fprintf(stderr, "ERROR: creating first test file %s\n", names[i]);
       error_count++;
     }
+    /* A second open gets its own handle (and read/write pointer) */
     tmp = sfs_fopen(names[i]);
-    if (tmp >= 0 && tmp != fds[i]) {
-      fprintf(stderr, "ERROR: file %s was opened twice\n", names[i]);
+    if (tmp < 0 || tmp == fds[i]) {
+      fprintf(stderr, "ERROR: second open of file %s did not get its own handle\n", names[i]);
+      error_count++;
+    } else if (sfs_fclose(tmp) != 0) {
+      fprintf(stderr, "ERROR: close of second handle on file %s failed\n", names[i]);
       error_count++;
     }
     filesize[i] = (rand() % (MAX_BYTES-MIN_BYTES)) + MIN_BYTES;
@@ -379,7 +383,7 @@ main(int argc, char **argv)
   }
 
   printf("Directory listing\n");
-  char *filename = (char *)malloc(MAXFILENAME);
+  char *filename = (char *)malloc(MAXFILENAME + 1);
   int max = 0;
   while (sfs_getnextfilename(filename)) {
 	  if (strcmp(filename, names[max]) != 0) {
@@ -5,6 +5,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <poll.h>
 
 #include "sfs_api.h"
 
@@ -21,6 +23,32 @@
 #define MAX_BYTES 30000 /* Maximum file size I'll try to create */
 #define MIN_BYTES 10000         /* Minimum file size */
 
+/* Files to create in one directory, enough that its name index needs
+ * more than one block.
+ */
+#define WIDE_FILES 300
+#define BATCH_FILES 100
+#define COPY_BLOCKS 150 /* Blocks of the file copied with sfs_copy_file_range */
+#define CLONE_BLOCKS 300 /* Blocks of the file cloned, more than the disk holds CLONES + 1 copies of */
+#define CLONES 4
+#define ASYNC_REQUESTS 32 /* Reads or writes in flight at once */
+#define ASYNC_SIZE 700
+#define BATCH_CREATES 20 /* Files created by one sfs_batch_submit */
+
+/* Results of asynchronous writes given back through async_done()
+ */
+static pthread_mutex_t async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_cond = PTHREAD_COND_INITIALIZER;
+static int async_callbacks = 0;
+
+static void async_done(sfs_async* request, int result, void* context) {
+  pthread_mutex_lock(&async_mutex);
+  *(int*) context = result;
+  async_callbacks++;
+  pthread_cond_signal(&async_cond);
+  pthread_mutex_unlock(&async_mutex);
+}
+
 /* rand_name() - return a randomly-generated, but legal, file name.
  *
  * This function creates a filename of the form xxxxxxxx.xxx, where
@@ -34,7 +62,7 @@
  
 char *rand_name() 
 {
-  char fname[MAXFILENAME];
+  char fname[MAXFILENAME + 1];
   int i;
 
   for (i = 0; i < MAXFILENAME; i++) {
@@ -136,7 +164,7 @@ main(int argc, char **argv) {
       }
     }
 
-    char* new_mem = realloc(buffer, MAXFILENAME);
+    char* new_mem = realloc(buffer, MAXFILENAME + 1);
     if(new_mem == NULL) {
       fprintf(stderr, "ERROR: Failed to reallocate buffer memory, exiting test\n");
       exit(EXIT_FAILURE);
@@ -352,6 +380,694 @@ main(int argc, char **argv) {
       error_count++;
     }
 
+    printf("Checking name lookups in a wide directory (create, remove every other, reopen)\n");
+    char wide_name[MAXFILENAME + 1];
+    for(i = 0; i < WIDE_FILES; i++) {
+      snprintf(wide_name, sizeof(wide_name), "wide%d.txt", i);
+      int wide_fd = sfs_fopen(wide_name);
+      if(wide_fd < 0) {
+        fprintf(stderr, "ERROR: Failed to create file %s in wide directory\n", wide_name);
+        error_count++;
+        continue;
+      }
+      sfs_fwrite(wide_fd, wide_name, strlen(wide_name));
+      sfs_fclose(wide_fd);
+    }
+    for(i = 0; i < WIDE_FILES; i += 2) {
+      snprintf(wide_name, sizeof(wide_name), "wide%d.txt", i);
+      if(sfs_remove(wide_name) < 0) {
+        fprintf(stderr, "ERROR: Failed to remove file %s in wide directory\n", wide_name);
+        error_count++;
+      }
+    }
+    for(i = 0; i < WIDE_FILES; i++) {
+      snprintf(wide_name, sizeof(wide_name), "wide%d.txt", i);
+      int wide_size = sfs_getfilesize(wide_name);
+      if(i % 2 == 0 && wide_size >= 0) {
+        fprintf(stderr, "ERROR: Removed file %s still found in wide directory\n", wide_name);
+        error_count++;
+      } else if(i % 2 == 1 && wide_size != (int) strlen(wide_name)) {
+        fprintf(stderr, "ERROR: File %s in wide directory has size %d, expected %d\n", wide_name, wide_size, (int) strlen(wide_name));
+        error_count++;
+      }
+    }
+    printf("Checking new files reuse the removed slots of a wide directory\n");
+    for(i = 0; i < WIDE_FILES / 2; i++) {
+      snprintf(wide_name, sizeof(wide_name), "reuse%d", i);
+      int wide_fd = sfs_fopen(wide_name);
+      sfs_fwrite(wide_fd, wide_name, strlen(wide_name));
+      sfs_fclose(wide_fd);
+      if(sfs_getfilesize(wide_name) != (int) strlen(wide_name)) {
+        fprintf(stderr, "ERROR: File %s created over a removed slot has size %d\n", wide_name, sfs_getfilesize(wide_name));
+        error_count++;
+      }
+    }
+    int listed = 0;
+    while(sfs_getnextfilename(wide_name)) {
+      if(strncmp(wide_name, "wide", 4) == 0 || strncmp(wide_name, "reuse", 5) == 0) listed++;
+    }
+    if(listed != WIDE_FILES) {
+      fprintf(stderr, "ERROR: Wide directory lists %d files, expected %d\n", listed, WIDE_FILES);
+      error_count++;
+    }
+    sfs_dirent wide_entries[64];
+    int wide_read;
+    listed = 0;
+    while((wide_read = sfs_readdirplus(wide_entries, 64)) > 0) {
+      for(int k = 0; k < wide_read; k++) {
+        if(strncmp(wide_entries[k].name, "wide", 4) != 0 && strncmp(wide_entries[k].name, "reuse", 5) != 0) continue;
+        listed++;
+        if(wide_entries[k].stat.size != (long) strlen(wide_entries[k].name) || wide_entries[k].stat.is_directory) {
+          fprintf(stderr, "ERROR: sfs_readdirplus gave size %ld for %s\n", wide_entries[k].stat.size, wide_entries[k].name);
+          error_count++;
+        }
+      }
+    }
+    if(listed != WIDE_FILES) {
+      fprintf(stderr, "ERROR: sfs_readdirplus lists %d files of the wide directory, expected %d\n", listed, WIDE_FILES);
+      error_count++;
+    }
+    for(i = 1; i < WIDE_FILES; i += 2) {
+      snprintf(wide_name, sizeof(wide_name), "wide%d.txt", i);
+      sfs_remove(wide_name);
+    }
+    for(i = 0; i < WIDE_FILES / 2; i++) {
+      snprintf(wide_name, sizeof(wide_name), "reuse%d", i);
+      sfs_remove(wide_name);
+    }
+
+    printf("Checking long names and entry types in a directory listing\n");
+    char long_name[MAXFILENAME + 1];
+    char entry_name[MAXFILENAME + 1];
+    memset(long_name, 'L', MAXFILENAME);
+    long_name[MAXFILENAME] = '\0';
+    if(sfs_mkdir("typedir") < 0 || sfs_loaddir("typedir") < 0) {
+      fprintf(stderr, "ERROR: Failed to create and load directory typedir\n");
+      error_count++;
+    } else {
+      sfs_mkdir("sub");
+      ex_fd = sfs_fopen(long_name);
+      if(ex_fd < 0) {
+        fprintf(stderr, "ERROR: Failed to create a file with a %d character name\n", MAXFILENAME);
+        error_count++;
+      }
+      sfs_fclose(ex_fd);
+      int is_directory;
+      if(!sfs_getnextentry(entry_name, &is_directory) || strcmp(entry_name, "sub") != 0 || !is_directory
+         || !sfs_getnextentry(entry_name, &is_directory) || strcmp(entry_name, long_name) != 0 || is_directory
+         || sfs_getnextentry(entry_name, &is_directory)) {
+        fprintf(stderr, "ERROR: Listing of typedir has wrong names or entry types\n");
+        error_count++;
+      }
+      sfs_loaddir("..");
+      sfs_remove("typedir");
+    }
+
+    printf("Checking repeated path lookups see removes and re-creates\n");
+    if(sfs_mkdir("cachedir") < 0 || sfs_loaddir("cachedir") < 0) {
+      fprintf(stderr, "ERROR: Failed to create and load directory cachedir\n");
+      error_count++;
+    } else {
+      ex_fd = sfs_fopen("inner");
+      sfs_fwrite(ex_fd, "12345", 5);
+      sfs_fclose(ex_fd);
+      sfs_loaddir("..");
+      for(i = 0; i < 3; i++) {
+        if(sfs_getfilesize("cachedir\\inner") != 5) {
+          fprintf(stderr, "ERROR: Lookup %d of path cachedir\\inner did not find its 5 bytes\n", i);
+          error_count++;
+        }
+      }
+      sfs_remove("cachedir");
+      if(sfs_getfilesize("cachedir\\inner") >= 0) {
+        fprintf(stderr, "ERROR: Path cachedir\\inner still found after its directory was removed\n");
+        error_count++;
+      }
+      sfs_mkdir("cachedir");
+      sfs_loaddir("cachedir");
+      ex_fd = sfs_fopen("inner");
+      sfs_fwrite(ex_fd, "123", 3);
+      sfs_fclose(ex_fd);
+      sfs_loaddir("..");
+      if(sfs_getfilesize("cachedir\\inner") != 3) {
+        fprintf(stderr, "ERROR: Path cachedir\\inner did not resolve to the re-created file\n");
+        error_count++;
+      }
+      sfs_remove("cachedir");
+    }
+
+    printf("Checking path functions leave the loaded directory alone\n");
+    sfs_mkdir("pathsub");
+    sfs_loaddir("pathsub");
+    ex_fd = sfs_fopen("here.txt");
+    sfs_fclose(ex_fd);
+    if(sfs_mkdir_path("pathdir") < 0 || sfs_mkdir_path("pathdir\\inner") < 0) {
+      fprintf(stderr, "ERROR: Failed to create directories pathdir\\inner by path\n");
+      error_count++;
+    }
+    if(sfs_mkdir_path("pathdir") >= 0) {
+      fprintf(stderr, "ERROR: Created directory pathdir by path twice\n");
+      error_count++;
+    }
+    ex_fd = sfs_open_path("pathdir\\inner\\data.txt");
+    if(ex_fd < 0 || sfs_fwrite(ex_fd, "1234567", 7) != 7) {
+      fprintf(stderr, "ERROR: Failed to create and write pathdir\\inner\\data.txt by path\n");
+      error_count++;
+    }
+    sfs_fclose(ex_fd);
+    sfs_stat path_stat;
+    if(sfs_stat_path("pathdir\\inner\\data.txt", &path_stat) < 0 || path_stat.size != 7 || path_stat.is_directory) {
+      fprintf(stderr, "ERROR: Stat by path of pathdir\\inner\\data.txt is wrong\n");
+      error_count++;
+    }
+    if(sfs_stat_path("pathdir\\inner", &path_stat) < 0 || !path_stat.is_directory) {
+      fprintf(stderr, "ERROR: Stat by path of directory pathdir\\inner is wrong\n");
+      error_count++;
+    }
+    if(sfs_open_path("missing\\x.txt") >= 0) {
+      fprintf(stderr, "ERROR: Opened a file by path in a missing directory\n");
+      error_count++;
+    }
+    if(sfs_remove_path("pathsub") >= 0) {
+      fprintf(stderr, "ERROR: Removed the loaded directory by path\n");
+      error_count++;
+    }
+    if(!sfs_getnextfilename(buffer) || strcmp(buffer, "here.txt") != 0 || sfs_getnextfilename(buffer)) {
+      fprintf(stderr, "ERROR: Path functions changed the loaded directory\n");
+      error_count++;
+    }
+    if(sfs_remove_path("pathdir") < 0 || sfs_stat_path("pathdir\\inner\\data.txt", &path_stat) >= 0) {
+      fprintf(stderr, "ERROR: Failed to remove directory pathdir by path\n");
+      error_count++;
+    }
+    sfs_loaddir("..");
+    sfs_remove("pathsub");
+
+    printf("Checking renames within and across directories\n");
+    sfs_mkdir_path("ren");
+    sfs_mkdir_path("ren\\a");
+    sfs_mkdir_path("ren\\b");
+    ex_fd = sfs_open_path("ren\\a\\tmp");
+    sfs_fwrite(ex_fd, "new data", 8);
+    sfs_fclose(ex_fd);
+    ex_fd = sfs_open_path("ren\\b\\out");
+    sfs_fwrite(ex_fd, "old", 3);
+    sfs_fclose(ex_fd);
+    if(sfs_rename("ren\\a\\tmp", "ren\\b\\out") < 0 || sfs_getfilesize("ren\\b\\out") != 8 || sfs_getfilesize("ren\\a\\tmp") >= 0) {
+      fprintf(stderr, "ERROR: Rename across directories did not replace ren\\b\\out\n");
+      error_count++;
+    }
+    if(sfs_rename("ren\\b\\out", "ren\\b\\final") < 0 || sfs_getfilesize("ren\\b\\final") != 8 || sfs_getfilesize("ren\\b\\out") >= 0) {
+      fprintf(stderr, "ERROR: Rename within directory ren\\b failed\n");
+      error_count++;
+    }
+    if(sfs_rename("ren\\a", "ren\\b\\a2") < 0 || sfs_rename("ren\\b", "ren\\b\\a2\\b") >= 0 || sfs_rename("ren\\b\\final", "missing\\final") >= 0) {
+      fprintf(stderr, "ERROR: Directory moves in ren gave the wrong results\n");
+      error_count++;
+    }
+    sfs_loaddir("ren");
+    sfs_loaddir("b");
+    sfs_loaddir("a2");
+    sfs_loaddir(".."); // Parent of the moved directory is now b
+    for(i = 0; sfs_getnextfilename(buffer); i++);
+    if(i != 2 || sfs_getfilesize("ren\\b\\a2") < 0) {
+      fprintf(stderr, "ERROR: Moved directory ren\\b\\a2 has the wrong parent (%d entries found)\n", i);
+      error_count++;
+    }
+    sfs_loaddir("..");
+    sfs_loaddir("..");
+    sfs_remove("ren");
+
+    printf("Checking sfs_copy_file_range copies between files\n");
+    char copy_buf[sizeof(fixedbuf)];
+    int copy_src = sfs_fopen("copysrc");
+    int copy_dst = sfs_fopen("copydst");
+    for(i = 0; i < COPY_BLOCKS; i++) {
+      memset(fixedbuf, (char) (i * 7 + 1), sizeof(fixedbuf));
+      fixedbuf[i % sizeof(fixedbuf)] = 0;
+      sfs_fwrite(copy_src, fixedbuf, sizeof(fixedbuf));
+    }
+    sfs_fwrite(copy_dst, "0123456789", 10);
+    long copy_length = COPY_BLOCKS * (long) sizeof(fixedbuf) - 100;
+    if(sfs_copy_file_range(copy_src, 100, copy_dst, 10, copy_length) != copy_length) {
+      fprintf(stderr, "ERROR: sfs_copy_file_range did not copy %ld bytes\n", copy_length);
+      error_count++;
+    }
+    for(long offset = 0; offset < copy_length; offset += sizeof(fixedbuf)) {
+      int n = sfs_pread(copy_src, fixedbuf, sizeof(fixedbuf), offset + 100);
+      if(sfs_pread(copy_dst, copy_buf, n, offset + 10) != n || memcmp(fixedbuf, copy_buf, n) != 0) {
+        fprintf(stderr, "ERROR: Data copied with sfs_copy_file_range differs at offset %ld\n", offset);
+        error_count++;
+        break;
+      }
+    }
+    if(sfs_pread(copy_dst, copy_buf, 10, 0) != 10 || strncmp(copy_buf, "0123456789", 10) != 0) {
+      fprintf(stderr, "ERROR: sfs_copy_file_range changed bytes before the destination offset\n");
+      error_count++;
+    }
+    if(sfs_copy_file_range(copy_src, 0, copy_src, 500, 1000) >= 0) {
+      fprintf(stderr, "ERROR: sfs_copy_file_range copied between overlapping ranges of one file\n");
+      error_count++;
+    }
+    sfs_fclose(copy_src);
+    sfs_fclose(copy_dst);
+    sfs_remove("copysrc");
+    sfs_remove("copydst");
+
+    printf("Checking clones share data until one is written\n");
+    char clone_name[16];
+    long clone_size = CLONE_BLOCKS * (long) sizeof(fixedbuf) + 15;
+    ex_fd = sfs_fopen("template");
+    for(i = 0; i < CLONE_BLOCKS; i++) {
+      memset(fixedbuf, (char) (i + 3), sizeof(fixedbuf));
+      sfs_fwrite(ex_fd, fixedbuf, sizeof(fixedbuf));
+    }
+    sfs_fwrite(ex_fd, "end of template", 15);
+    sfs_fclose(ex_fd);
+    for(i = 0; i < CLONES; i++) {
+      snprintf(clone_name, sizeof(clone_name), "clone%d", i);
+      if(sfs_clone("template", clone_name) < 0 || sfs_getfilesize(clone_name) != clone_size) {
+        fprintf(stderr, "ERROR: Failed to clone template as %s\n", clone_name);
+        error_count++;
+      }
+    }
+    if(sfs_clone("template", "clone0") >= 0) {
+      fprintf(stderr, "ERROR: Cloned over the existing file clone0\n");
+      error_count++;
+    }
+    // Overwrite inside one clone, append to the shared last block of another and delete from the end of a third
+    ex_fd = sfs_fopen("clone0");
+    sfs_pwrite(ex_fd, "changed", 7, 280 * sizeof(fixedbuf) + 5);
+    sfs_fclose(ex_fd);
+    ex_fd = sfs_fopen("clone1");
+    sfs_fwrite(ex_fd, "tail", 4);
+    sfs_fclose(ex_fd);
+    ex_fd = sfs_fopen("clone2");
+    sfs_fdelete(ex_fd, 2000);
+    sfs_fclose(ex_fd);
+
+    ex_fd = sfs_fopen("template");
+    memset(fixedbuf, (char) (280 + 3), 7);
+    if(sfs_pread(ex_fd, copy_buf, 7, 280 * sizeof(fixedbuf) + 5) != 7 || memcmp(copy_buf, fixedbuf, 7) != 0
+       || sfs_pread(ex_fd, copy_buf, 20, clone_size - 15) != 15 || strncmp(copy_buf, "end of template", 15) != 0) {
+      fprintf(stderr, "ERROR: Writes to clones changed the template\n");
+      error_count++;
+    }
+    sfs_fclose(ex_fd);
+    ex_fd = sfs_fopen("clone0");
+    if(sfs_pread(ex_fd, copy_buf, 7, 280 * sizeof(fixedbuf) + 5) != 7 || strncmp(copy_buf, "changed", 7) != 0) {
+      fprintf(stderr, "ERROR: Write to clone0 was lost\n");
+      error_count++;
+    }
+    sfs_fclose(ex_fd);
+    ex_fd = sfs_fopen("clone1");
+    if(sfs_pread(ex_fd, copy_buf, 20, clone_size - 15) != 19 || strncmp(copy_buf, "end of templatetail", 19) != 0) {
+      fprintf(stderr, "ERROR: Append to clone1 was lost\n");
+      error_count++;
+    }
+    sfs_fclose(ex_fd);
+    if(sfs_getfilesize("clone2") != clone_size - 2000 || sfs_getfilesize("clone3") != clone_size) {
+      fprintf(stderr, "ERROR: Deleting from the end of clone2 gave sizes %d and %d\n", sfs_getfilesize("clone2"), sfs_getfilesize("clone3"));
+      error_count++;
+    }
+    sfs_remove("template");
+    ex_fd = sfs_fopen("clone3");
+    memset(fixedbuf, (char) (CLONE_BLOCKS - 1 + 3), sizeof(fixedbuf));
+    if(sfs_pread(ex_fd, copy_buf, sizeof(copy_buf), (CLONE_BLOCKS - 1) * sizeof(fixedbuf)) != sizeof(copy_buf) 
+       || memcmp(copy_buf, fixedbuf, sizeof(copy_buf)) != 0) {
+      fprintf(stderr, "ERROR: clone3 lost its data when the template was removed\n");
+      error_count++;
+    }
+    sfs_fclose(ex_fd);
+    for(i = 0; i < CLONES; i++) {
+      snprintf(clone_name, sizeof(clone_name), "clone%d", i);
+      sfs_remove(clone_name);
+    }
+
+    printf("Checking hard links share one file until the last is removed\n");
+    sfs_mkdir_path("links");
+    ex_fd = sfs_open_path("links\\a");
+    sfs_fwrite(ex_fd, "shared", 6);
+    sfs_fclose(ex_fd);
+    if(sfs_link("links\\a", "b") < 0 || sfs_stat_path("b", &path_stat) < 0 || path_stat.link_count != 2 || path_stat.size != 6) {
+      fprintf(stderr, "ERROR: Failed to link links\\a as b\n");
+      error_count++;
+    }
+    if(sfs_link("links\\a", "b") >= 0 || sfs_link("links", "dirlink") >= 0) {
+      fprintf(stderr, "ERROR: Linked over an existing name or linked a directory\n");
+      error_count++;
+    }
+    ex_fd = sfs_fopen("b");
+    sfs_fwrite(ex_fd, "!", 1);
+    sfs_fclose(ex_fd);
+    sfs_remove("b");
+    if(sfs_stat_path("links\\a", &path_stat) < 0 || path_stat.link_count != 1 || path_stat.size != 7) {
+      fprintf(stderr, "ERROR: links\\a is wrong after writing and removing its link b\n");
+      error_count++;
+    }
+    sfs_link("links\\a", "c");
+    sfs_remove("links");
+    if(sfs_stat_path("c", &path_stat) < 0 || path_stat.link_count != 1 || path_stat.size != 7) {
+      fprintf(stderr, "ERROR: Removing directory links deleted the file still linked as c\n");
+      error_count++;
+    }
+    sfs_remove("c");
+
+    printf("Checking sessions keep their own directory, listing and handles\n");
+    sfs_mkdir_path("sess");
+    sfs_mkdir_path("sess\\a");
+    sfs_mkdir_path("sess\\b");
+    sfs_session* sessions[2] = {sfs_session_open(), sfs_session_open()};
+    int session_fds[2];
+    char session_dir[2][2] = {"a", "b"};
+    for(i = 0; i < 2; i++) {
+      if(sessions[i] == NULL || sfs_session_loaddir(sessions[i], "sess") < 0
+         || sfs_session_loaddir(sessions[i], session_dir[i]) < 0) {
+        fprintf(stderr, "ERROR: Session %d failed to load its directory\n", i);
+        error_count++;
+        break;
+      }
+      session_fds[i] = sfs_session_fopen(sessions[i], "f.txt");
+      sfs_fwrite(session_fds[i], session_dir[i], 1);
+    }
+    if(i == 2) {
+      int is_dir;
+      char session_name[MAXFILENAME + 1];
+      // Listings of both sessions interleaved, each sees only its own directory
+      for(i = 0; i < 2; i++) {
+        if(sfs_session_getnextentry(sessions[i], session_name, &is_dir) != 1 || strcmp(session_name, "f.txt") != 0) {
+          fprintf(stderr, "ERROR: Session %d listed the wrong first entry\n", i);
+          error_count++;
+        }
+      }
+      for(i = 0; i < 2; i++) {
+        if(sfs_session_getnextentry(sessions[i], session_name, &is_dir) != 0) {
+          fprintf(stderr, "ERROR: Session %d listed more than its one entry\n", i);
+          error_count++;
+        }
+      }
+      if(sfs_stat_path("sess\\b\\f.txt", &path_stat) < 0 || path_stat.size != 1 || sfs_getfilesize("f.txt") >= 0) {
+        fprintf(stderr, "ERROR: Session file created in the wrong directory\n");
+        error_count++;
+      }
+      if(sfs_remove_path("sess\\a") >= 0 || sfs_remove("sess") >= 0) {
+        fprintf(stderr, "ERROR: Removed the current directory of a session\n");
+        error_count++;
+      }
+      if(sfs_fclose(session_fds[0]) >= 0 || sfs_session_fclose(sessions[1], session_fds[0]) >= 0) {
+        fprintf(stderr, "ERROR: Closed a handle of another session\n");
+        error_count++;
+      }
+      sfs_session_close(sessions[0]);
+      if(sfs_pread(session_fds[0], buffer, 1, 0) >= 0 || sfs_session_fclose(sessions[1], session_fds[1]) < 0) {
+        fprintf(stderr, "ERROR: Session handles not closed by their own session\n");
+        error_count++;
+      }
+      sfs_session_close(sessions[1]);
+      if(sfs_remove("sess") < 0) {
+        fprintf(stderr, "ERROR: Failed to remove directories of closed sessions\n");
+        error_count++;
+      }
+    }
+
+    printf("Checking mounted file systems keep their own files\n");
+    char* mount_paths[2] = {"mount_a.sfs", "mount_b.sfs"};
+    sfs_options mount_options[2] = {{.fresh = 1},
+                                    {.fresh = 1, .block_size = 2048, .file_system_size = 4096, .inode_table_length = 16}};
+    sfs_options bad_options = {.fresh = 1, .block_size = 1024, .file_system_size = 16384};
+    sfs_t* mounts[2];
+    char mount_data[2][3000];
+    char mount_check[3001];
+    if(sfs_mount("mount_bad.sfs", &bad_options) != NULL || sfs_mount("mount_missing.sfs", NULL) != NULL) {
+      fprintf(stderr, "ERROR: Mounted a file system that can't fit its geometry or doesn't exist\n");
+      error_count++;
+    }
+    for(i = 0; i < 2; i++) {
+      memset(mount_data[i], 'x' + i, sizeof(mount_data[i]));
+      mounts[i] = sfs_mount(mount_paths[i], &mount_options[i]);
+      sfs_t* previous = sfs_use(mounts[i]);
+      int mount_fd = sfs_fopen("mounted.txt");
+      if(mounts[i] == NULL || mount_fd < 0 || sfs_fwrite(mount_fd, mount_data[i], sizeof(mount_data[i]) - i) != sizeof(mount_data[i]) - i) {
+        fprintf(stderr, "ERROR: Failed to write a file in mounted file system %d\n", i);
+        error_count++;
+      }
+      sfs_fclose(mount_fd);
+      sfs_use(previous);
+    }
+    if(sfs_getfilesize("mounted.txt") >= 0) {
+      fprintf(stderr, "ERROR: File of a mounted file system found in the default one\n");
+      error_count++;
+    }
+    for(i = 0; i < 2; i++) sfs_unmount(mounts[i]);
+    for(i = 0; i < 2; i++) {
+      mounts[i] = sfs_mount(mount_paths[i], NULL);
+      sfs_use(mounts[i]);
+      int mount_fd = sfs_fopen("mounted.txt");
+      if(mounts[i] == NULL || sfs_getfilesize("mounted.txt") != sizeof(mount_data[i]) - i
+         || sfs_fread(mount_fd, mount_check, sizeof(mount_check)) != sizeof(mount_data[i]) - i
+         || memcmp(mount_check, mount_data[i], sizeof(mount_data[i]) - i) != 0) {
+        fprintf(stderr, "ERROR: Mounted file system %d has the wrong file after mounting it again\n", i);
+        error_count++;
+      }
+      sfs_unmount(mounts[i]); // Back to the default file system
+      remove(mount_paths[i]);
+    }
+    if(sfs_getfilesize("mounted.txt") >= 0 || sfs_stat_path("sess", &path_stat) >= 0) {
+      fprintf(stderr, "ERROR: Default file system changed by mounted ones\n");
+      error_count++;
+    }
+
+    printf("Checking asynchronous reads and writes\n");
+    static char async_data[ASYNC_REQUESTS][ASYNC_SIZE];
+    static char async_check[ASYNC_REQUESTS][ASYNC_SIZE];
+    sfs_async_completion completions[ASYNC_REQUESTS];
+    int async_results[ASYNC_REQUESTS];
+    int async_seen[ASYNC_REQUESTS] = {0};
+    int async_file = sfs_open_path("async.dat");
+    memset(async_check, 0, sizeof(async_check));
+    sfs_fwrite(async_file, (char*) async_check, sizeof(async_check)); /* Writes only overwrite */
+    for(i = 0; i < ASYNC_REQUESTS; i++) {
+      memset(async_data[i], 'A' + i, ASYNC_SIZE);
+      async_results[i] = -1;
+      /* Every other write tells async_done(), the others go on the completion queue */
+      sfs_async* request = sfs_write_async(async_file, async_data[i], ASYNC_SIZE, (long) i * ASYNC_SIZE,
+                                           (i % 2) ? async_done : NULL, (i % 2) ? (void*) &async_results[i] : (void*) (long) i);
+      if(request == NULL) {
+        fprintf(stderr, "ERROR: Failed to start asynchronous write %d\n", i);
+        error_count++;
+      }
+    }
+    for(int reaped = 0; reaped < ASYNC_REQUESTS / 2; ) {
+      int got = sfs_async_reap(completions, ASYNC_REQUESTS, 1);
+      if(got <= 0) {
+        fprintf(stderr, "ERROR: Asynchronous writes missing from the completion queue\n");
+        error_count++;
+        break;
+      }
+      for(int k = 0; k < got; k++) {
+        long index = (long) completions[k].context;
+        if(completions[k].result != ASYNC_SIZE || async_seen[index]++ != 0) {
+          fprintf(stderr, "ERROR: Asynchronous write %ld completed wrongly\n", index);
+          error_count++;
+        }
+      }
+      reaped += got;
+    }
+    pthread_mutex_lock(&async_mutex);
+    while(async_callbacks < ASYNC_REQUESTS / 2) pthread_cond_wait(&async_cond, &async_mutex);
+    pthread_mutex_unlock(&async_mutex);
+    for(i = 1; i < ASYNC_REQUESTS; i += 2) {
+      if(async_results[i] != ASYNC_SIZE) {
+        fprintf(stderr, "ERROR: Asynchronous write %d called back with %d\n", i, async_results[i]);
+        error_count++;
+      }
+    }
+
+    /* Read everything back through the completion queue, waiting on its file descriptor */
+    struct pollfd async_poll = {.fd = sfs_async_fd(), .events = POLLIN};
+    for(i = 0; i < ASYNC_REQUESTS; i++) {
+      sfs_read_async(async_file, async_check[i], ASYNC_SIZE, (long) i * ASYNC_SIZE, NULL, (void*) (long) i);
+    }
+    sfs_read_async(-1, async_check[0], 1, 0, NULL, (void*) (long) -1);
+    int async_reads = 0;
+    while(async_reads < ASYNC_REQUESTS + 1 && poll(&async_poll, 1, 5000) == 1) {
+      int got = sfs_async_reap(completions, ASYNC_REQUESTS, 0);
+      for(int k = 0; k < got; k++) {
+        long index = (long) completions[k].context;
+        if((index < 0) != (completions[k].result < 0) || (index >= 0 && completions[k].result != ASYNC_SIZE)) {
+          fprintf(stderr, "ERROR: Asynchronous read %ld completed with %d\n", index, completions[k].result);
+          error_count++;
+        }
+      }
+      async_reads += got;
+    }
+    if(async_reads != ASYNC_REQUESTS + 1 || poll(&async_poll, 1, 0) != 0 || sfs_async_reap(completions, 1, 1) != 0) {
+      fprintf(stderr, "ERROR: Completion queue has %d of %d reads, or is still ready when empty\n", async_reads, ASYNC_REQUESTS + 1);
+      error_count++;
+    }
+    if(memcmp(async_check, async_data, sizeof(async_data)) != 0) {
+      fprintf(stderr, "ERROR: Asynchronous reads don't match the asynchronous writes\n");
+      error_count++;
+    }
+    sfs_fclose(async_file);
+    sfs_remove_path("async.dat");
+
+    printf("Checking removal of a directory tree\n");
+    char tree_path[64];
+    int round;
+    for(round = 0; round < 2; round++) {
+      sfs_mkdir_path("tree");
+      for(i = 0; i < 4; i++) {
+        snprintf(tree_path, sizeof(tree_path), "tree\\d%d", i);
+        sfs_mkdir_path(tree_path);
+        snprintf(tree_path, sizeof(tree_path), "tree\\d%d\\inner", i);
+        sfs_mkdir_path(tree_path);
+        for(int k = 0; k < 5; k++) {
+          snprintf(tree_path, sizeof(tree_path), "tree\\d%d\\inner\\f%d", i, k);
+          int tree_fd = sfs_open_path(tree_path);
+          if(tree_fd < 0 || sfs_fwrite(tree_fd, fixedbuf, sizeof(fixedbuf)) != sizeof(fixedbuf)) {
+            fprintf(stderr, "ERROR: Failed to create and write %s (round %d)\n", tree_path, round);
+            error_count++;
+          }
+          sfs_fclose(tree_fd);
+        }
+      }
+      if(sfs_remove("tree") < 0 || sfs_getfilesize("tree\\d3\\inner\\f4") >= 0 || sfs_getfilesize("tree") >= 0) {
+        fprintf(stderr, "ERROR: Directory tree still found after removing it (round %d)\n", round);
+        error_count++;
+      }
+    }
+    /* The background reclaimer may have freed some of it already */
+    if(sfs_reclaim(-1) < 0 || sfs_reclaim(-1) != 0) {
+      fprintf(stderr, "ERROR: sfs_reclaim left part of the removed tree on the orphan list\n");
+      error_count++;
+    }
+
+    printf("Checking files created together with sfs_create_many\n");
+    char batch_names[BATCH_FILES][MAXFILENAME + 1];
+    char* batch_list[BATCH_FILES];
+    int batch_fds[BATCH_FILES];
+    for(i = 0; i < BATCH_FILES; i++) {
+      snprintf(batch_names[i], sizeof(batch_names[i]), "batch%d", i);
+      batch_list[i] = batch_names[i];
+    }
+    sfs_mkdir("batchdir");
+    sfs_loaddir("batchdir");
+    if(sfs_create_many(batch_list, BATCH_FILES, batch_fds) != BATCH_FILES) {
+      fprintf(stderr, "ERROR: Failed to create %d files with sfs_create_many\n", BATCH_FILES);
+      error_count++;
+    } else {
+      for(i = 0; i < BATCH_FILES; i++) {
+        sfs_fwrite(batch_fds[i], batch_names[i], strlen(batch_names[i]));
+        sfs_fclose(batch_fds[i]);
+      }
+      char batch_path[MAXFILENAME + 16];
+      for(i = 0; i < BATCH_FILES; i++) {
+        snprintf(batch_path, sizeof(batch_path), "batchdir\\%s", batch_names[i]);
+        if(sfs_getfilesize(batch_path) != (int) strlen(batch_names[i])) {
+          fprintf(stderr, "ERROR: File %s from sfs_create_many has size %d\n", batch_names[i], sfs_getfilesize(batch_path));
+          error_count++;
+        }
+      }
+    }
+    sfs_loaddir("..");
+    sfs_set_prefetch(1);
+    if(sfs_loaddir("batchdir") < 0) {
+      fprintf(stderr, "ERROR: Failed to load directory batchdir with prefetching on\n");
+      error_count++;
+    }
+    for(i = 0; i < BATCH_FILES; i += 10) {
+      int batch_fd = sfs_fopen(batch_names[i]);
+      if(batch_fd < 0 || sfs_fread(batch_fd, fixedbuf, 5) != 5 || strncmp(fixedbuf, "batch", 5) != 0) {
+        fprintf(stderr, "ERROR: File %s read wrong after a prefetching load\n", batch_names[i]);
+        error_count++;
+      }
+      sfs_fclose(batch_fd);
+    }
+    sfs_set_prefetch(0);
+    strcpy(batch_names[1], "fresh");
+    if(sfs_create_many(batch_list, 2, batch_fds) >= 0 || sfs_getfilesize("batchdir\\fresh") >= 0) {
+      fprintf(stderr, "ERROR: sfs_create_many created files although batch0 already exists\n");
+      error_count++;
+    }
+    strcpy(batch_names[0], "fresh");
+    if(sfs_create_many(batch_list, 2, batch_fds) >= 0) {
+      fprintf(stderr, "ERROR: sfs_create_many created a repeated name twice\n");
+      error_count++;
+    }
+    sfs_loaddir("..");
+    sfs_remove("batchdir");
+
+    printf("Checking batched creates, writes, removes and renames\n");
+    char batch_path[32];
+    char batch_data[1500];
+    char batch_check[1501];
+    int batch_results[BATCH_CREATES + 8];
+    memset(batch_data, 'b', sizeof(batch_data));
+    sfs_options batch_options = {.fresh = 1};
+    sfs_t* batch_fs = sfs_mount("batch.sfs", &batch_options);
+    sfs_t* batch_previous = sfs_use(batch_fs);
+    sfs_mkdir_path("bdir");
+    sfs_batch* batch = sfs_batch_open();
+    for(i = 0; i < BATCH_CREATES; i++) {
+      snprintf(batch_path, sizeof(batch_path), "bdir\\f%d", i);
+      sfs_batch_create(batch, batch_path);
+    }
+    sfs_batch_write(batch, "bdir\\f0", "hello", 5, 0);
+    sfs_batch_write(batch, "bdir\\new.txt", batch_data, sizeof(batch_data), 0); /* Created by the write */
+    sfs_batch_create(batch, "bdir\\f1");                                        /* Fails, already there */
+    sfs_batch_write(batch, "bdir\\f2", "x", 1, 10);                             /* Fails, past the end */
+    sfs_batch_rename(batch, "bdir\\f3", "moved.txt");
+    sfs_batch_remove(batch, "bdir\\f4");
+    sfs_batch_remove(batch, "bdir\\missing");                                   /* Fails */
+    int batch_succeeded = sfs_batch_submit(batch, batch_results);
+    if(batch_fs == NULL || batch_succeeded != BATCH_CREATES + 4 || batch_results[0] != 0
+       || batch_results[BATCH_CREATES] != 5 || batch_results[BATCH_CREATES + 1] != sizeof(batch_data)
+       || batch_results[BATCH_CREATES + 2] >= 0 || batch_results[BATCH_CREATES + 3] >= 0
+       || batch_results[BATCH_CREATES + 4] != 0 || batch_results[BATCH_CREATES + 5] != 0 || batch_results[BATCH_CREATES + 6] >= 0) {
+      fprintf(stderr, "ERROR: Batch had %d operations succeed, or wrong results\n", batch_succeeded);
+      error_count++;
+    }
+    sfs_unmount(batch_fs);
+
+    /* Everything must be on disk once the batch is submitted */
+    batch_fs = sfs_mount("batch.sfs", NULL);
+    sfs_use(batch_fs);
+    int batch_fd = sfs_open_path("bdir\\new.txt");
+    if(batch_fs == NULL || sfs_getfilesize("bdir\\f0") != 5 || sfs_getfilesize("moved.txt") != 0
+       || sfs_getfilesize("bdir\\f3") >= 0 || sfs_getfilesize("bdir\\f4") >= 0
+       || sfs_fread(batch_fd, batch_check, sizeof(batch_check)) != sizeof(batch_data)
+       || memcmp(batch_check, batch_data, sizeof(batch_data)) != 0) {
+      fprintf(stderr, "ERROR: Batched changes missing after mounting again\n");
+      error_count++;
+    }
+    sfs_fclose(batch_fd);
+    for(i = 5; i < BATCH_CREATES; i++) {
+      snprintf(batch_path, sizeof(batch_path), "bdir\\f%d", i);
+      if(sfs_getfilesize(batch_path) != 0) {
+        fprintf(stderr, "ERROR: Batched file %s missing after mounting again\n", batch_path);
+        error_count++;
+      }
+    }
+
+    /* The same batch again, emptied by the submit */
+    for(i = 0; i < BATCH_CREATES; i++) {
+      snprintf(batch_path, sizeof(batch_path), "bdir\\f%d", i);
+      if(i != 3 && i != 4) sfs_batch_remove(batch, batch_path);
+    }
+    sfs_batch_remove(batch, "bdir\\new.txt");
+    sfs_batch_remove(batch, "moved.txt");
+    sfs_batch_remove(batch, "bdir");
+    if(sfs_batch_submit(batch, NULL) != BATCH_CREATES + 1 || sfs_stat_path("bdir", &path_stat) >= 0
+       || sfs_reclaim(-1) < 0 || sfs_reclaim(-1) != 0) {
+      fprintf(stderr, "ERROR: Batched removes left files behind\n");
+      error_count++;
+    }
+    sfs_batch_close(batch);
+    sfs_unmount(batch_fs);
+    sfs_use(batch_previous);
+    remove("batch.sfs");
+
     printf("Ensuring space has been cleared with remove, filling new file with repeated writes. May take a while...\n");
     ex_fd = sfs_fopen("HotPocketVillage.txt");
 
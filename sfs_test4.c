@@ -0,0 +1,322 @@
+/* sfs_test4.c
+ * Stress test of the file system used from several threads at once, and of
+ * file systems mounted side by side.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sfs_api.h"
+
+/* Threads each writing (and checking) their own file, while another
+ * creates and removes files in a directory of its own.
+ */
+#define THREADS 6
+#define ROUNDS 60
+
+/* More threads doing the same, each in a file system image it mounts itself
+ */
+#define MOUNT_THREADS 2
+
+/* Largest single write, and most bytes a thread's file grows to.
+ */
+#define MAX_WRITE 4096
+#define MAX_FILE_BYTES 60000
+
+/* Bytes of one shared file each thread owns (and writes concurrently with
+ * the others), at most MAX_WRITE.
+ */
+#define SHARED_REGION 4096
+#define CHURN_FILES 40
+
+typedef struct worker {
+  int id;
+  unsigned int seed;
+  char* shadow;    /* What the thread's file should hold */
+  long size;
+  int shared_fd;   /* -1 in a mounted image */
+  char* image;     /* Image the thread mounts and uses (NULL for the default file system) */
+  int errors;
+} worker;
+
+/* Fill buf with bytes no other write (or thread) would give
+ */
+static void fill(char* buf, int length, int id, int round) {
+  for (int i = 0; i < length; i++) {
+    buf[i] = (char) (id * 41 + round * 7 + i * 13);
+  }
+}
+
+/* Read length bytes at offset and compare them with the shadow copy
+ */
+static int check_range(worker* w, int fd, long offset, int length, char* buf) {
+  int bytes_read = sfs_pread(fd, buf, length, offset);
+  if (bytes_read != length) {
+    fprintf(stderr, "ERROR: Thread %d read %d bytes at %ld, expected %d\n", w->id, bytes_read, offset, length);
+    return 1;
+  }
+  if (memcmp(buf, w->shadow + offset, length) != 0) {
+    fprintf(stderr, "ERROR: Thread %d read back wrong data at %ld (%d bytes)\n", w->id, offset, length);
+    return 1;
+  }
+  return 0;
+}
+
+static void* run_worker(void* arg) {
+  worker* w = arg;
+  char name[MAXFILENAME + 1];
+  char* buf = malloc(MAX_WRITE);
+  char* check = malloc(MAX_FILE_BYTES);
+
+  snprintf(name, sizeof(name), "thread%d.dat", w->id);
+  sfs_t* fs = NULL;
+  if (w->image != NULL) {
+    sfs_options options = {.fresh = 1};
+    fs = sfs_mount(w->image, &options);
+    if (fs == NULL) {
+      fprintf(stderr, "ERROR: Thread %d could not mount %s\n", w->id, w->image);
+      w->errors++;
+      free(buf);
+      free(check);
+      return NULL;
+    }
+    sfs_use(fs);
+  }
+  int fd = sfs_fopen(name);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR: Thread %d could not open %s\n", w->id, name);
+    w->errors++;
+    free(buf);
+    free(check);
+    return NULL;
+  }
+
+  for (int round = 0; round < ROUNDS; round++) {
+    int length = 1 + rand_r(&w->seed) % MAX_WRITE;
+    fill(buf, length, w->id, round);
+
+    switch (rand_r(&w->seed) % 3) {
+    case 0: /* Append with the write pointer (always at the end) */
+      if (w->size + length > MAX_FILE_BYTES) break;
+      if (sfs_fwrite(fd, buf, length) != length) {
+        fprintf(stderr, "ERROR: Thread %d failed to append %d bytes\n", w->id, length);
+        w->errors++;
+        break;
+      }
+      memcpy(w->shadow + w->size, buf, length);
+      w->size += length;
+      break;
+    case 1: /* Overwrite somewhere inside */
+      if (w->size < length) break;
+      {
+        long offset = rand_r(&w->seed) % (w->size - length + 1);
+        if (sfs_pwrite(fd, buf, length, offset) != length) {
+          fprintf(stderr, "ERROR: Thread %d failed to overwrite %d bytes at %ld\n", w->id, length, offset);
+          w->errors++;
+          break;
+        }
+        memcpy(w->shadow + offset, buf, length);
+      }
+      break;
+    default: /* Copy the first half of the file over the second */
+      if (w->size < 2) break;
+      {
+        long half = w->size / 2;
+        if (sfs_copy_file_range(fd, 0, fd, half, half) != half) {
+          fprintf(stderr, "ERROR: Thread %d failed to copy %ld bytes in its file\n", w->id, half);
+          w->errors++;
+          break;
+        }
+        memmove(w->shadow + half, w->shadow, half);
+      }
+      break;
+    }
+
+    /* Something already written must still read back */
+    if (w->size > 0) {
+      long offset = rand_r(&w->seed) % w->size;
+      int check_length = 1 + rand_r(&w->seed) % MAX_WRITE;
+      if (check_length > w->size - offset) check_length = w->size - offset;
+      w->errors += check_range(w, fd, offset, check_length, check);
+    }
+
+    /* This thread's region of the shared file */
+    if (w->shared_fd < 0) continue;
+    fill(buf, SHARED_REGION, w->id, round);
+    if (sfs_pwrite(w->shared_fd, buf, SHARED_REGION, (long) w->id * SHARED_REGION) != SHARED_REGION) {
+      fprintf(stderr, "ERROR: Thread %d failed to write its region of the shared file\n", w->id);
+      w->errors++;
+    } else if (sfs_pread(w->shared_fd, check, SHARED_REGION, (long) w->id * SHARED_REGION) != SHARED_REGION
+               || memcmp(buf, check, SHARED_REGION) != 0) {
+      fprintf(stderr, "ERROR: Thread %d read back wrong data from its region of the shared file\n", w->id);
+      w->errors++;
+    }
+  }
+
+  /* The whole file, then once more after it is closed and opened again */
+  if (w->size > 0) w->errors += check_range(w, fd, 0, w->size, check);
+  sfs_fclose(fd);
+  fd = sfs_fopen(name);
+  if (sfs_getfilesize(name) != w->size) {
+    fprintf(stderr, "ERROR: Thread %d file is %d bytes, expected %ld\n", w->id, sfs_getfilesize(name), w->size);
+    w->errors++;
+  } else if (w->size > 0) {
+    w->errors += check_range(w, fd, 0, w->size, check);
+  }
+  sfs_fclose(fd);
+
+  /* A mounted image holds the file once mounted again */
+  if (fs != NULL) {
+    sfs_unmount(fs);
+    fs = sfs_mount(w->image, NULL);
+    sfs_use(fs);
+    fd = sfs_fopen(name);
+    if (fs == NULL || sfs_getfilesize(name) != w->size) {
+      fprintf(stderr, "ERROR: Thread %d file is wrong after mounting %s again\n", w->id, w->image);
+      w->errors++;
+    } else if (w->size > 0) {
+      w->errors += check_range(w, fd, 0, w->size, check);
+    }
+    sfs_unmount(fs);
+    remove(w->image);
+  }
+
+  free(buf);
+  free(check);
+  return NULL;
+}
+
+/* Creates, writes, checks and removes files in its own directory while the workers run
+ */
+static void* run_churn(void* arg) {
+  int* errors = arg;
+  char path[64];
+  char buf[256];
+  char check[256];
+
+  for (int i = 0; i < CHURN_FILES; i++) {
+    snprintf(path, sizeof(path), "churn\\file%d", i);
+    int fd = sfs_open_path(path);
+    if (fd < 0) {
+      fprintf(stderr, "ERROR: Could not create %s\n", path);
+      (*errors)++;
+      continue;
+    }
+    memset(buf, 'a' + i % 26, sizeof(buf));
+    sfs_fwrite(fd, buf, sizeof(buf));
+    if (sfs_pread(fd, check, sizeof(check), 0) != sizeof(check) || memcmp(buf, check, sizeof(buf)) != 0) {
+      fprintf(stderr, "ERROR: Wrong data read back from %s\n", path);
+      (*errors)++;
+    }
+    sfs_fclose(fd);
+
+    sfs_stat stat;
+    if (sfs_stat_path(path, &stat) < 0 || stat.size != sizeof(buf)) {
+      fprintf(stderr, "ERROR: Wrong size of %s\n", path);
+      (*errors)++;
+    }
+    if (i % 2 == 0 && sfs_remove_path(path) < 0) {
+      fprintf(stderr, "ERROR: Could not remove %s\n", path);
+      (*errors)++;
+    }
+    if (i % 10 == 9) sfs_reclaim(-1);
+  }
+  return NULL;
+}
+
+int
+main(int argc, char **argv) {
+  pthread_t threads[THREADS + MOUNT_THREADS + 1];
+  worker workers[THREADS + MOUNT_THREADS];
+  char images[MOUNT_THREADS][32];
+  int churn_errors = 0;
+  int error_count = 0;
+  char* buf = malloc(SHARED_REGION * THREADS);
+
+  mksfs(1);
+
+  /* The shared file starts out holding every region, so each can be overwritten */
+  int shared_fd = sfs_fopen("shared.dat");
+  memset(buf, 0, SHARED_REGION * THREADS);
+  if (shared_fd < 0 || sfs_fwrite(shared_fd, buf, SHARED_REGION * THREADS) != SHARED_REGION * THREADS) {
+    fprintf(stderr, "ERROR: Could not create the shared file\n");
+    error_count++;
+  }
+  if (sfs_mkdir_path("churn") < 0) {
+    fprintf(stderr, "ERROR: Could not create the churn directory\n");
+    error_count++;
+  }
+
+  printf("Running %d threads writing and checking their own files and one shared file, %d more in their own images\n",
+         THREADS, MOUNT_THREADS);
+  for (int i = 0; i < THREADS + MOUNT_THREADS; i++) {
+    workers[i] = (worker) {.id = i, .seed = 1000 + i, .shadow = malloc(MAX_FILE_BYTES), .size = 0,
+                           .shared_fd = shared_fd, .image = NULL, .errors = 0};
+    if (i >= THREADS) {
+      snprintf(images[i - THREADS], sizeof(images[i - THREADS]), "thread%d.sfs", i);
+      workers[i].shared_fd = -1;
+      workers[i].image = images[i - THREADS];
+    }
+    pthread_create(threads + i, NULL, run_worker, workers + i);
+  }
+  pthread_create(threads + THREADS + MOUNT_THREADS, NULL, run_churn, &churn_errors);
+  for (int i = 0; i <= THREADS + MOUNT_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  for (int i = 0; i < THREADS + MOUNT_THREADS; i++) {
+    error_count += workers[i].errors;
+  }
+  for (int i = THREADS; i < THREADS + MOUNT_THREADS; i++) {
+    free(workers[i].shadow);
+  }
+  error_count += churn_errors;
+
+  printf("Checking the shared file holds each thread's last write\n");
+  char* expected = malloc(SHARED_REGION);
+  if (sfs_pread(shared_fd, buf, SHARED_REGION * THREADS, 0) != SHARED_REGION * THREADS) {
+    fprintf(stderr, "ERROR: Could not read the shared file back\n");
+    error_count++;
+  } else {
+    for (int i = 0; i < THREADS; i++) {
+      fill(expected, SHARED_REGION, i, ROUNDS - 1);
+      if (memcmp(buf + i * SHARED_REGION, expected, SHARED_REGION) != 0) {
+        fprintf(stderr, "ERROR: Region %d of the shared file is wrong\n", i);
+        error_count++;
+      }
+    }
+  }
+  sfs_fclose(shared_fd);
+
+  printf("Reloading the file system and checking every file again\n");
+  mksfs(0);
+  for (int i = 0; i < THREADS; i++) {
+    char name[MAXFILENAME + 1];
+    snprintf(name, sizeof(name), "thread%d.dat", i);
+    char* data = malloc(workers[i].size + 1);
+    int fd = sfs_fopen(name);
+    if (fd < 0 || sfs_fread(fd, data, workers[i].size + 1) != workers[i].size
+        || memcmp(data, workers[i].shadow, workers[i].size) != 0) {
+      fprintf(stderr, "ERROR: %s is wrong after reloading\n", name);
+      error_count++;
+    }
+    sfs_fclose(fd);
+    free(data);
+    free(workers[i].shadow);
+  }
+  for (int i = 0; i < CHURN_FILES; i++) {
+    char path[64];
+    sfs_stat stat;
+    snprintf(path, sizeof(path), "churn\\file%d", i);
+    if ((sfs_stat_path(path, &stat) < 0) != (i % 2 == 0)) {
+      fprintf(stderr, "ERROR: %s should %s after reloading\n", path, (i % 2 == 0) ? "be removed" : "exist");
+      error_count++;
+    }
+  }
+
+  free(expected);
+  free(buf);
+  printf("Test program exiting with %d errors\n", error_count);
+  return (error_count);
+}